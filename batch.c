@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "list.h"
+#include "watchtower.h"
+#include "writer.h"
+#include "parallel.h"
+#include "batch.h"
+
+#define JOBS 64
+#define LINE_SIZE 4096
+#define SEPARATORS " \t\r\n"
+
+/* The dcel and watchtower table a worker thread reads every one of its jobs into, made by its first job */
+typedef struct {
+    dcel_t *dcel;
+    towertable_t *towers;
+} batchWorker_t;
+
+typedef struct {
+    manifest_t *manifest;
+    int isWalk;
+    int failedNum;
+    batchWorker_t *workers;
+} batch_t;
+
+/* Read a manifest of jobs, one a line as "watchtowers polygon splits output". Blank lines and lines
+   starting with # are skipped. Returns NULL, having said why on stderr, if a line is not a job */
+manifest_t *readManifest(FILE *file, char *filename) {
+
+    char line[LINE_SIZE];
+    int lineNum = 0;
+    manifest_t *manifest = (manifest_t *) malloc(sizeof(manifest_t));
+    assert(manifest);
+
+    manifest->jobsNum = 0;
+    manifest->maxJobs = JOBS;
+    manifest->jobs = (batchJob_t *) malloc(manifest->maxJobs * sizeof(batchJob_t));
+    assert(manifest->jobs);
+
+    while (fgets(line, LINE_SIZE, file) != NULL) {
+        batchJob_t job;
+        char *first;
+        lineNum++;
+
+        if (strchr(line, '\n') == NULL && !feof(file)) {
+            fprintf(stderr, "Line %d of %s is longer than %d characters\n", lineNum, filename, LINE_SIZE - 2);
+            freeManifest(manifest);
+            return NULL;
+        }
+        first = line + strspn(line, SEPARATORS);
+        if (*first == '\0' || *first == '#') {
+            continue;
+        }
+
+        job.line = strdup(first);
+        assert(job.line);
+        job.towersName = strtok(job.line, SEPARATORS);
+        job.polygonName = strtok(NULL, SEPARATORS);
+        job.splitsName = strtok(NULL, SEPARATORS);
+        job.outputName = strtok(NULL, SEPARATORS);
+        if (job.outputName == NULL || strtok(NULL, SEPARATORS) != NULL) {
+            fprintf(stderr, "Line %d of %s should name watchtowers, polygon, splits and output\n", lineNum,
+                    filename);
+            free(job.line);
+            freeManifest(manifest);
+            return NULL;
+        }
+
+        if (manifest->jobsNum == manifest->maxJobs) {
+            manifest->maxJobs *= 2;
+            manifest->jobs = realloc(manifest->jobs, manifest->maxJobs * sizeof(batchJob_t));
+            assert(manifest->jobs);
+        }
+        manifest->jobs[manifest->jobsNum++] = job;
+    }
+
+    return manifest;
+}
+
+/* Open a file of a job, saying on stderr if it cannot be */
+static FILE *openJobFile(int jobIdx, char *filename, char *mode) {
+
+    FILE *file = fopen(filename, mode);
+
+    if (file == NULL) {
+        fprintf(stderr, "Job %d: could not open %s\n", jobIdx + 1, filename);
+    }
+    return file;
+}
+
+/* Run one job on a worker thread. The job reads its polygon and watchtowers into the worker's dcel and
+   table, which keep the storage of the worker's earlier jobs, and runs single threaded as the batch
+   spreads the jobs themselves over the threads */
+static void runJob(void *arg, int jobIdx, int threadIdx) {
+
+    batch_t *batch = (batch_t *) arg;
+    batchJob_t *job = &(batch->manifest->jobs[jobIdx]);
+    batchWorker_t *worker = &(batch->workers[threadIdx]);
+    FILE *towersFile = NULL, *polygonFile = NULL, *splitsFile = NULL, *output = NULL;
+    splitPair_t *splits = NULL;
+    int splitsNum;
+
+    if ((towersFile = openJobFile(jobIdx, job->towersName, "r")) == NULL ||
+        (polygonFile = openJobFile(jobIdx, job->polygonName, "r")) == NULL ||
+        (splitsFile = openJobFile(jobIdx, job->splitsName, "r")) == NULL ||
+        (output = openJobFile(jobIdx, job->outputName, "w")) == NULL) {
+        __atomic_fetch_add(&(batch->failedNum), 1, __ATOMIC_RELAXED);
+        if (towersFile != NULL) {
+            fclose(towersFile);
+        }
+        if (polygonFile != NULL) {
+            fclose(polygonFile);
+        }
+        if (splitsFile != NULL) {
+            fclose(splitsFile);
+        }
+        return;
+    }
+
+    if (worker->towers == NULL) {
+        worker->towers = readWatchtower(towersFile, 1);
+    } else {
+        reloadWatchtower(worker->towers, towersFile, 1);
+    }
+    if (worker->dcel == NULL) {
+        worker->dcel = constructInitialDcel(polygonFile);
+    } else {
+        resetDcel(worker->dcel, polygonFile);
+    }
+
+    splits = readSplits(splitsFile, &splitsNum);
+    applySplits(worker->dcel, splits, splitsNum, 1);
+    writeWatchTower(output, worker->dcel, worker->towers, 1, batch->isWalk);
+
+    free(splits);
+    fclose(output);
+    fclose(splitsFile);
+    fclose(polygonFile);
+    fclose(towersFile);
+}
+
+/* Run the jobs of a manifest over threadsNum threads, each writing its own output file. The threads are
+   started once for the whole batch and take jobs in manifest order until none are left. Returns the
+   number of jobs that could not be run */
+int runBatch(manifest_t *manifest, int threadsNum, int isWalk) {
+
+    batch_t batch = {manifest, isWalk, 0, NULL};
+
+    batch.workers = (batchWorker_t *) calloc(threadsNum, sizeof(batchWorker_t));
+    assert(batch.workers);
+
+    parallelFor(manifest->jobsNum, threadsNum, runJob, &batch);
+
+    for (int t = 0; t < threadsNum; t++) {
+        if (batch.workers[t].towers != NULL) {
+            freeWatchTower(batch.workers[t].towers);
+        }
+        if (batch.workers[t].dcel != NULL) {
+            freeList(batch.workers[t].dcel);
+        }
+    }
+    free(batch.workers);
+
+    return batch.failedNum;
+}
+
+/* Free a manifest and the lines of its jobs */
+void freeManifest(manifest_t *manifest) {
+
+    for (int i = 0; i < manifest->jobsNum; i++) {
+        free(manifest->jobs[i].line);
+    }
+    free(manifest->jobs);
+    free(manifest);
+}
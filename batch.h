@@ -0,0 +1,26 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+    #include <stdio.h>
+
+    /* A job of a batch: the watchtowers, polygon and splits to read and the file its output goes to. The
+       names point into line, a copy of the job's line of the manifest */
+    typedef struct {
+        char *line;
+        char *towersName;
+        char *polygonName;
+        char *splitsName;
+        char *outputName;
+    } batchJob_t;
+
+    typedef struct {
+        int jobsNum;
+        int maxJobs;
+        batchJob_t *jobs;
+    } manifest_t;
+
+    manifest_t *readManifest(FILE *file, char *filename);
+    int runBatch(manifest_t *manifest, int threadsNum, int isWalk);
+    void freeManifest(manifest_t *manifest);
+
+#endif
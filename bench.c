@@ -0,0 +1,365 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdint.h>
+#include "watchtower.h"
+#include "list.h"
+#include "writer.h"
+#include "towertree.h"
+
+#define USAGE "Usage: %s [-t threads] [-r repeats] [-q] results.csv\n"
+#define RADIUS_X 100.0
+#define RADIUS_Y 80.0
+#define CENTRE_X 150.0
+#define CENTRE_Y -20.0
+#define CLUSTERS 8
+#define CLUSTER_SPREAD 3.0
+#define MIN_SINE 0.000001
+#define SPLIT_TRIES 50
+#define SEED 88172645463325252ull
+#define QUERIES_NUM 200
+#define QUERY_SIZE 10.0
+#define STAGES_NUM 7
+
+/* One point of the sweep */
+typedef struct {
+    int verticesNum;
+    int splitsNum;
+    int towersNum;
+    int isClustered;
+} benchCase_t;
+
+/* Many random splits leave faces with edges too short to be tight, which take in wide wedges of the grid,
+   so the largest split count is kept to the smaller watchtower count */
+static benchCase_t fullSweep[] = {
+    {1000, 10000, 100000, 0},
+    {1000, 10000, 100000, 1},
+    {1000, 100000, 100000, 0},
+    {1000, 10000, 1000000, 0},
+    {1000, 10000, 1000000, 1},
+    {100000, 10000, 1000000, 0},
+};
+
+static benchCase_t quickSweep[] = {
+    {100, 1000, 10000, 0},
+    {100, 1000, 10000, 1},
+    {1000, 10000, 100000, 0},
+};
+
+/* Xorshift generator, so every run of the sweep sees the same input */
+static uint64_t nextRandom(uint64_t *state) {
+
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/* Uniform double in [0, 1) */
+static double uniform(uint64_t *state) {
+
+    return (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Standard normal double, by Box-Muller */
+static double normal(uint64_t *state) {
+
+    return sqrt(-2 * log(1 - uniform(state))) * cos(2 * M_PI * uniform(state));
+}
+
+/* Seconds on the monotonic clock */
+static double now(void) {
+
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/* Write a convex polygon with the given number of vertices, clockwise on an ellipse */
+static FILE *makePolygon(int verticesNum) {
+
+    FILE *file = tmpfile();
+    assert(file);
+
+    for (int i = 0; i < verticesNum; i++) {
+        double angle = -2 * M_PI * i / verticesNum;
+        fprintf(file, "%.17g %.17g\n", CENTRE_X + RADIUS_X * cos(angle), CENTRE_Y + RADIUS_Y * sin(angle));
+    }
+    rewind(file);
+    return file;
+}
+
+/* Write watchtowers drawn uniformly over the box of the polygon, or around a few centres */
+static FILE *makeTowers(int towersNum, int isClustered, uint64_t *state) {
+
+    FILE *file = tmpfile();
+    assert(file);
+    double centreX[CLUSTERS], centreY[CLUSTERS], x, y;
+
+    for (int c = 0; c < CLUSTERS; c++) {
+        centreX[c] = CENTRE_X + RADIUS_X * (2 * uniform(state) - 1);
+        centreY[c] = CENTRE_Y + RADIUS_Y * (2 * uniform(state) - 1);
+    }
+
+    fprintf(file, "Watchtower ID,Postcode,Population Served,Watchtower Point of Contact Name,x,y\n");
+    for (int j = 0; j < towersNum; j++) {
+        if (isClustered) {
+            int c = nextRandom(state) % CLUSTERS;
+            x = centreX[c] + CLUSTER_SPREAD * normal(state);
+            y = centreY[c] + CLUSTER_SPREAD * normal(state);
+        } else {
+            x = CENTRE_X + RADIUS_X * (2 * uniform(state) - 1);
+            y = CENTRE_Y + RADIUS_Y * (2 * uniform(state) - 1);
+        }
+        fprintf(file, "WT%07d,%d,%d,Contact %d,%.17g,%.17g\n", j, 3000 + (int) (nextRandom(state) % 1000),
+                (int) (nextRandom(state) % 100000), j, x, y);
+    }
+    rewind(file);
+    return file;
+}
+
+/* Write random valid splits: each joins two edges of a random face that are not parallel, found by applying
+   them to a dcel of the polygon as they are drawn */
+static FILE *makeSplits(FILE *polygon, int splitsNum, uint64_t *state) {
+
+    FILE *file = tmpfile();
+    assert(file);
+    dcel_t *dcel = constructInitialDcel(polygon);
+    halfedge_t *halfEdges = NULL;
+    int made = 0, tries = 0;
+
+    rewind(polygon);
+    while (made < splitsNum && tries < splitsNum * SPLIT_TRIES) {
+        int faceIdx = nextRandom(state) % dcel->facesNum, halfEdgesNum = dcel->faces[faceIdx].halfEdgesNum;
+        int first = nextRandom(state) % halfEdgesNum, second = nextRandom(state) % halfEdgesNum;
+        int tmp = dcel->faces[faceIdx].halfEdge, startHalfEdge = -1, endHalfEdge = -1;
+
+        tries++;
+        if (first == second) {
+            continue;
+        }
+        halfEdges = dcel->halfEdges;
+        for (int k = 0; k < halfEdgesNum; k++) {
+            if (k == first) {
+                startHalfEdge = tmp;
+            }
+            if (k == second) {
+                endHalfEdge = tmp;
+            }
+            tmp = halfEdges[tmp].next;
+        }
+
+        /* Parallel edges would give a face with no area */
+        vertex_t a = dcel->vertices[halfEdges[startHalfEdge].startVertexIdx];
+        vertex_t b = dcel->vertices[halfEdges[startHalfEdge].endVertexIdx];
+        vertex_t c = dcel->vertices[halfEdges[endHalfEdge].startVertexIdx];
+        vertex_t d = dcel->vertices[halfEdges[endHalfEdge].endVertexIdx];
+        double cross = (b.x - a.x) * (d.y - c.y) - (b.y - a.y) * (d.x - c.x);
+        if (fabs(cross) < MIN_SINE * hypot(b.x - a.x, b.y - a.y) * hypot(d.x - c.x, d.y - c.y)) {
+            continue;
+        }
+
+        /* The split may move the half-edges, so take the edges first */
+        int startEdge = halfEdges[startHalfEdge].edgeIdx, endEdge = halfEdges[endHalfEdge].edgeIdx;
+        if (applySplit(dcel, startEdge, endEdge) != NO_FACE) {
+            fprintf(file, "%d %d\n", startEdge, endEdge);
+            made++;
+        }
+    }
+
+    freeList(dcel);
+    rewind(file);
+    return file;
+}
+
+/* Random queries of each kind in turn, over the box of the polygon */
+static towerQuery_t *makeQueries(uint64_t *state) {
+
+    towerQuery_t *queries = (towerQuery_t *) malloc(QUERIES_NUM * sizeof(towerQuery_t));
+    assert(queries);
+
+    for (int q = 0; q < QUERIES_NUM; q++) {
+        queries[q].kind = q % 3;
+        queries[q].a = CENTRE_X + RADIUS_X * (2 * uniform(state) - 1);
+        queries[q].b = CENTRE_Y + RADIUS_Y * (2 * uniform(state) - 1);
+        queries[q].c = queries[q].kind == QUERY_RECTANGLE ? queries[q].a + QUERY_SIZE * uniform(state) :
+                                                            QUERY_SIZE * uniform(state);
+        queries[q].d = queries[q].b + QUERY_SIZE * uniform(state);
+    }
+    return queries;
+}
+
+/* Answer a query by scanning every watchtower, the population it gives and the tower for nearest */
+static long long scanQuery(towertable_t *towers, towerQuery_t *query, int *found) {
+
+    long long population = 0;
+    double best = INFINITY;
+
+    *found = query->kind == QUERY_NEAREST ? -1 : 0;
+    for (int j = 0; j < towers->towersNum; j++) {
+        double x = towers->x[j], y = towers->y[j], distance;
+        if (query->kind == QUERY_RECTANGLE) {
+            if (x >= query->a && x <= query->c && y >= query->b && y <= query->d) {
+                (*found)++;
+                population += towers->populationServed[j];
+            }
+        } else if (query->kind == QUERY_RADIUS) {
+            if ((x - query->a) * (x - query->a) + (y - query->b) * (y - query->b) <= query->c * query->c) {
+                (*found)++;
+                population += towers->populationServed[j];
+            }
+        } else {
+            distance = (x - query->a) * (x - query->a) + (y - query->b) * (y - query->b);
+            if (distance < best) {
+                best = distance;
+                *found = j;
+            }
+        }
+    }
+    return population;
+}
+
+/* Answer a query through the k-d tree, in the same form as scanQuery */
+static long long treeQuery(towerTree_t *tree, towerQuery_t *query, int *found) {
+
+    bbox_t box = {query->a, query->b, query->c, query->d};
+
+    if (query->kind == QUERY_RECTANGLE) {
+        return rectangleSum(tree, &box, found);
+    }
+    if (query->kind == QUERY_RADIUS) {
+        return radiusSum(tree, query->a, query->b, query->c, found);
+    }
+    *found = nearestTower(tree, query->a, query->b);
+    return 0;
+}
+
+/* Time each stage of one case and append a line per stage to the results */
+static void runCase(benchCase_t *test, int threadsNum, int repeat, FILE *results) {
+
+    uint64_t state = SEED;
+    FILE *polygon = makePolygon(test->verticesNum);
+    FILE *towerFile = makeTowers(test->towersNum, test->isClustered, &state);
+    FILE *splitFile = makeSplits(polygon, test->splitsNum, &state);
+    FILE *output = fopen("/dev/null", "w");
+    assert(output);
+    towertable_t *towers = NULL;
+    dcel_t *dcel = NULL;
+    splitPair_t *splits = NULL;
+    towerTree_t *tree = NULL;
+    towerQuery_t *queries = makeQueries(&state);
+    long long treeAnswers[QUERIES_NUM], scanAnswers[QUERIES_NUM];
+    int treeFound[QUERIES_NUM], scanFound[QUERIES_NUM];
+    double start, seconds[STAGES_NUM];
+    int splitsNum;
+
+    start = now();
+    towers = readWatchtower(towerFile, threadsNum);
+    seconds[0] = now() - start;
+
+    start = now();
+    dcel = constructInitialDcel(polygon);
+    seconds[1] = now() - start;
+
+    start = now();
+    splits = readSplits(splitFile, &splitsNum);
+    applySplits(dcel, splits, splitsNum, threadsNum);
+    seconds[2] = now() - start;
+
+    start = now();
+    writeWatchTower(output, dcel, towers, threadsNum, 0);
+    fflush(output);
+    seconds[3] = now() - start;
+
+    /* The k-d tree against a scan of every watchtower, which must agree on every answer */
+    start = now();
+    tree = buildTowerTree(towers);
+    seconds[4] = now() - start;
+
+    start = now();
+    for (int q = 0; q < QUERIES_NUM; q++) {
+        treeAnswers[q] = treeQuery(tree, &(queries[q]), &(treeFound[q]));
+    }
+    seconds[5] = now() - start;
+
+    start = now();
+    for (int q = 0; q < QUERIES_NUM; q++) {
+        scanAnswers[q] = scanQuery(towers, &(queries[q]), &(scanFound[q]));
+    }
+    seconds[6] = now() - start;
+
+    for (int q = 0; q < QUERIES_NUM; q++) {
+        if (treeAnswers[q] != scanAnswers[q] || treeFound[q] != scanFound[q]) {
+            fprintf(stderr, "Query %d of kind %d: the tree gives %lld from %d, a scan %lld from %d\n", q,
+                    queries[q].kind, treeAnswers[q], treeFound[q], scanAnswers[q], scanFound[q]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    char *stages[] = {"readWatchtower", "constructInitialDcel", "split", "writeWatchTower", "buildTowerTree",
+                      "treeQueries", "scanQueries"};
+    for (int s = 0; s < STAGES_NUM; s++) {
+        fprintf(results, "%d,%d,%d,%s,%d,%d,%s,%.6f\n", test->verticesNum, splitsNum, test->towersNum,
+                test->isClustered ? "clustered" : "uniform", threadsNum, repeat, stages[s], seconds[s]);
+    }
+    fflush(results);
+
+    free(queries);
+    freeTowerTree(tree);
+    free(splits);
+    freeList(dcel);
+    freeWatchTower(towers);
+    fclose(output);
+    fclose(splitFile);
+    fclose(towerFile);
+    fclose(polygon);
+}
+
+int main(int argc, char *argv[]) {
+
+    int threadsNum = 1, repeats = 1, casesNum = sizeof(fullSweep) / sizeof(fullSweep[0]), option;
+    benchCase_t *sweep = fullSweep;
+    FILE *results = NULL;
+
+    while ((option = getopt(argc, argv, "t:r:q")) != -1) {
+        switch (option) {
+            case 't':
+                threadsNum = atoi(optarg);
+                break;
+            case 'r':
+                repeats = atoi(optarg);
+                break;
+            case 'q':
+                sweep = quickSweep;
+                casesNum = sizeof(quickSweep) / sizeof(quickSweep[0]);
+                break;
+            default:
+                fprintf(stderr, USAGE, argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (argc - optind < 1 || threadsNum < 1 || repeats < 1) {
+        fprintf(stderr, USAGE, argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    results = fopen(argv[optind], "w");
+    assert(results);
+    fprintf(results, "vertices,splits,towers,distribution,threads,repeat,stage,seconds\n");
+
+    for (int c = 0; c < casesNum; c++) {
+        for (int r = 0; r < repeats; r++) {
+            fprintf(stderr, "%d vertices, %d splits, %d %s watchtowers, run %d\n", sweep[c].verticesNum,
+                    sweep[c].splitsNum, sweep[c].towersNum, sweep[c].isClustered ? "clustered" : "uniform", r + 1);
+            runCase(&sweep[c], threadsNum, r, results);
+        }
+    }
+
+    fclose(results);
+    return 0;
+}
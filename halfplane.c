@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+#include "list.h"
+#include "halfplane.h"
+#include "stats.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define EPSILON 0.000001d
+
+/* Work out the coefficients of the half-plane of an edge, following the branches of isOfHalfPlane.
+   A point passes if any rule that applies to the edge accepts it */
+void edgeHalfPlane(vertex_t start, vertex_t end, halfplane_t *halfPlane) {
+
+    int isVertical = fabs(start.x - end.x) < EPSILON;
+
+    halfPlane->xStart = start.x;
+    halfPlane->gradient = 0;
+    halfPlane->intercept = 0;
+    halfPlane->rules = 0;
+
+    if (isVertical && start.y < end.y) {
+        halfPlane->rules |= VERTICAL_UP;
+    }
+    if (start.x < end.x) {
+        halfPlane->rules |= RISING;
+    } else {
+        if (isVertical && (start.y > end.y || fabs(start.y - end.y) < EPSILON)) {
+            halfPlane->rules |= VERTICAL_DOWN;
+        }
+        if (start.x > end.x) {
+            halfPlane->rules |= FALLING;
+        }
+    }
+    if (start.x != end.x) {
+        halfPlane->gradient = (end.y - start.y)/(end.x - start.x);
+        halfPlane->intercept = end.y - halfPlane->gradient * end.x;
+    }
+}
+
+/* Write the half-planes of every half-edge in a face, returns how many there are */
+int faceHalfPlanes(dcel_t *dcel, int faceIdx, halfplane_t *halfPlanes) {
+
+    int start = dcel->faces[faceIdx].halfEdge, tmp = start, halfPlanesNum = 0;
+
+    do {
+        edgeHalfPlane(dcel->vertices[dcel->halfEdges[tmp].startVertexIdx],
+                      dcel->vertices[dcel->halfEdges[tmp].endVertexIdx], &(halfPlanes[halfPlanesNum++]));
+        tmp = dcel->halfEdges[tmp].next;
+    } while (tmp != start);
+
+    STATS_WALK(faceWalks, halfPlanesNum);
+    return halfPlanesNum;
+}
+
+/* Check if a given point is of a half-plane, gives the same answer as isOfHalfPlane on its edge */
+int isOfHalfPlaneCoefficients(halfplane_t *halfPlane, double targetX, double targetY) {
+
+    double yPredicted = halfPlane->gradient * targetX + halfPlane->intercept;
+    double yR = targetY - yPredicted;
+
+    STATS_COUNT(coefficientTests, 1);
+    return ((halfPlane->rules & VERTICAL_UP) && targetX > halfPlane->xStart) ||
+           ((halfPlane->rules & RISING) && yR <= 0) ||
+           ((halfPlane->rules & VERTICAL_DOWN) && targetX <= halfPlane->xStart) ||
+           ((halfPlane->rules & FALLING) && yR >= 0);
+}
+
+/* Classify points one at a time, from a given point onwards */
+static void classifyScalar(halfplane_t *halfPlanes, int halfPlanesNum, double *targetX, double *targetY,
+                           int from, int targetsNum, unsigned char *isInside) {
+
+    for (int j = from; j < targetsNum; j++) {
+        isInside[j] = 1;
+        for (int k = 0; k < halfPlanesNum; k++) {
+            if (!isOfHalfPlaneCoefficients(&(halfPlanes[k]), targetX[j], targetY[j])) {
+                isInside[j] = 0;
+                break;
+            }
+        }
+    }
+}
+
+#if defined(__x86_64__)
+
+/* All bits set if a rule applies to a half-plane */
+#define RULE_MASK(halfPlane, rule) (-(long long) (((halfPlane)->rules & (rule)) != 0))
+
+/* Classify points two at a time with SSE2, returns how many points were done */
+static int classifySse2(halfplane_t *halfPlanes, int halfPlanesNum, double *targetX, double *targetY,
+                        int targetsNum, unsigned char *isInside) {
+
+    int j;
+
+    for (j = 0; j + 2 <= targetsNum; j += 2) {
+        __m128d x = _mm_loadu_pd(targetX + j), y = _mm_loadu_pd(targetY + j);
+        __m128d inside = _mm_castsi128_pd(_mm_set1_epi64x(-1));
+        for (int k = 0; k < halfPlanesNum; k++) {
+            halfplane_t *halfPlane = &(halfPlanes[k]);
+            __m128d xStart = _mm_set1_pd(halfPlane->xStart);
+            __m128d yPredicted = _mm_add_pd(_mm_mul_pd(_mm_set1_pd(halfPlane->gradient), x),
+                                            _mm_set1_pd(halfPlane->intercept));
+            __m128d yR = _mm_sub_pd(y, yPredicted), zero = _mm_setzero_pd();
+            __m128d accept = _mm_and_pd(_mm_castsi128_pd(_mm_set1_epi64x(RULE_MASK(halfPlane, VERTICAL_UP))),
+                                        _mm_cmpgt_pd(x, xStart));
+            accept = _mm_or_pd(accept, _mm_and_pd(_mm_castsi128_pd(_mm_set1_epi64x(RULE_MASK(halfPlane, RISING))),
+                                                  _mm_cmple_pd(yR, zero)));
+            accept = _mm_or_pd(accept, _mm_and_pd(_mm_castsi128_pd(_mm_set1_epi64x(RULE_MASK(halfPlane, VERTICAL_DOWN))),
+                                                  _mm_cmple_pd(x, xStart)));
+            accept = _mm_or_pd(accept, _mm_and_pd(_mm_castsi128_pd(_mm_set1_epi64x(RULE_MASK(halfPlane, FALLING))),
+                                                  _mm_cmpge_pd(yR, zero)));
+            inside = _mm_and_pd(inside, accept);
+            if (!_mm_movemask_pd(inside)) {
+                break;
+            }
+        }
+        int mask = _mm_movemask_pd(inside);
+        isInside[j] = mask & 1;
+        isInside[j + 1] = (mask >> 1) & 1;
+    }
+
+    return j;
+}
+
+/* Classify points four at a time with AVX2, returns how many points were done */
+__attribute__((target("avx2")))
+static int classifyAvx2(halfplane_t *halfPlanes, int halfPlanesNum, double *targetX, double *targetY,
+                        int targetsNum, unsigned char *isInside) {
+
+    int j;
+
+    for (j = 0; j + 4 <= targetsNum; j += 4) {
+        __m256d x = _mm256_loadu_pd(targetX + j), y = _mm256_loadu_pd(targetY + j);
+        __m256d inside = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        for (int k = 0; k < halfPlanesNum; k++) {
+            halfplane_t *halfPlane = &(halfPlanes[k]);
+            __m256d xStart = _mm256_set1_pd(halfPlane->xStart);
+            __m256d yPredicted = _mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(halfPlane->gradient), x),
+                                               _mm256_set1_pd(halfPlane->intercept));
+            __m256d yR = _mm256_sub_pd(y, yPredicted), zero = _mm256_setzero_pd();
+            __m256d accept = _mm256_and_pd(_mm256_castsi256_pd(_mm256_set1_epi64x(RULE_MASK(halfPlane, VERTICAL_UP))),
+                                           _mm256_cmp_pd(x, xStart, _CMP_GT_OQ));
+            accept = _mm256_or_pd(accept, _mm256_and_pd(_mm256_castsi256_pd(_mm256_set1_epi64x(RULE_MASK(halfPlane, RISING))),
+                                                        _mm256_cmp_pd(yR, zero, _CMP_LE_OQ)));
+            accept = _mm256_or_pd(accept, _mm256_and_pd(_mm256_castsi256_pd(_mm256_set1_epi64x(RULE_MASK(halfPlane, VERTICAL_DOWN))),
+                                                        _mm256_cmp_pd(x, xStart, _CMP_LE_OQ)));
+            accept = _mm256_or_pd(accept, _mm256_and_pd(_mm256_castsi256_pd(_mm256_set1_epi64x(RULE_MASK(halfPlane, FALLING))),
+                                                        _mm256_cmp_pd(yR, zero, _CMP_GE_OQ)));
+            inside = _mm256_and_pd(inside, accept);
+            if (!_mm256_movemask_pd(inside)) {
+                break;
+            }
+        }
+        int mask = _mm256_movemask_pd(inside);
+        for (int lane = 0; lane < 4; lane++) {
+            isInside[j + lane] = (mask >> lane) & 1;
+        }
+    }
+
+    return j;
+}
+
+#endif
+
+/* Classify a block of points against all half-planes of a face, isInside[j] is set to 1 if point j
+   passes every one of them. Uses AVX2 or SSE2 where available and finishes the tail one at a time */
+void classifyBatch(halfplane_t *halfPlanes, int halfPlanesNum, double *targetX, double *targetY,
+                   int targetsNum, unsigned char *isInside) {
+
+    int done = 0;
+
+    STATS_COUNT(classifyBatches, 1);
+    STATS_COUNT(classifiedPoints, targetsNum);
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2")) {
+        done = classifyAvx2(halfPlanes, halfPlanesNum, targetX, targetY, targetsNum, isInside);
+    } else {
+        done = classifySse2(halfPlanes, halfPlanesNum, targetX, targetY, targetsNum, isInside);
+    }
+#endif
+
+    classifyScalar(halfPlanes, halfPlanesNum, targetX, targetY, done, targetsNum, isInside);
+}
@@ -0,0 +1,26 @@
+#ifndef HALFPLANE_H
+#define HALFPLANE_H
+
+    #include "list.h"
+
+    /* Rules of isOfHalfPlane that apply to an edge */
+    #define VERTICAL_UP 1
+    #define RISING 2
+    #define VERTICAL_DOWN 4
+    #define FALLING 8
+
+    /* Line coefficients of a half-edge, worked out once so that testing a point needs no division */
+    typedef struct {
+        double xStart;
+        double gradient;
+        double intercept;
+        int rules;
+    } halfplane_t;
+
+    void edgeHalfPlane(vertex_t start, vertex_t end, halfplane_t *halfPlane);
+    int faceHalfPlanes(dcel_t *dcel, int faceIdx, halfplane_t *halfPlanes);
+    int isOfHalfPlaneCoefficients(halfplane_t *halfPlane, double targetX, double targetY);
+    void classifyBatch(halfplane_t *halfPlanes, int halfPlanesNum, double *targetX, double *targetY,
+                       int targetsNum, unsigned char *isInside);
+
+#endif
@@ -2,77 +2,159 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <math.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
 #include "list.h"
+#include "parallel.h"
+#include "stats.h"
 
-#define VERTICES 3
 #define FACE 1
 #define EXTRA_VERTICES 2
 #define EXTRA_EDGES 3
 #define EXTRA_FACE 1
 #define EPSILON 0.000001d
-
-/* Read vertices from input file */
-vertex_t *readVertices(FILE *file, int *currentSize) {
-
-    vertex_t *vertices;
-    double xCoord, yCoord;
-    int maxVertices = VERTICES;
-
-    vertices = (vertex_t *) malloc(VERTICES * sizeof(vertex_t));
-    assert(vertices);
-    
-    while (fscanf(file, "%lf %lf", &xCoord, &yCoord) > 0) {
-        if (*currentSize == maxVertices) {
-            maxVertices *= 2;
-            vertices = realloc(vertices, maxVertices * sizeof(vertex_t));
-            assert(vertices);
-        }
-        vertices[*currentSize].x = xCoord;
-        vertices[*currentSize].y = yCoord;
-        (*currentSize)++;
-    }
-
-    return vertices;
-}
+#define SPLITS 64
+#define SPLIT_BLOCK 65536
+#define WAVE_TASK 32
 
 /* Construct initial doubly connected edge list with vertices, (half)edges and face read from input files */
 dcel_t *constructInitialDcel(FILE *file) {
 
     dcel_t *dcel = (dcel_t *) malloc(sizeof(dcel_t));
     assert(dcel);
+    dcel->allocations = 1;
+
+    /* Start with no storage at all, resetting the dcel allocates what the polygon needs */
+    dcel->verticesNum = dcel->edgesNum = dcel->facesNum = 0;
+    dcel->maxVertices = dcel->maxEdges = dcel->maxFaces = 0;
+    dcel->vertices = NULL;
+    dcel->edges = NULL;
+    dcel->faces = NULL;
+    dcel->halfEdges = NULL;
+    dcel->journalNum = dcel->maxJournal = 0;
+    dcel->journal = NULL;
+    dcel->checkpointsNum = dcel->maxCheckpoints = 0;
+    dcel->checkpoints = NULL;
+    resetDcel(dcel, file);
+
+    return dcel;
+}
+
+/* Make a dcel the initial dcel of the polygon read from input file again, in the storage it already has.
+   Capacities only ever grow, so a dcel reused for many polygons stops allocating once it has held the
+   largest of them */
+void resetDcel(dcel_t *dcel, FILE *file) {
+
+    double xCoord, yCoord;
 
     /* Read vertices */
-    dcel->verticesNum = 0;
-    dcel->vertices = readVertices(file, &(dcel->verticesNum));
+    dcel->verticesNum = dcel->edgesNum = dcel->facesNum = 0;
+    while (fscanf(file, "%lf %lf", &xCoord, &yCoord) > 0) {
+        growDcel(dcel, 1, 0, 0);
+        dcel->vertices[dcel->verticesNum].x = xCoord;
+        dcel->vertices[dcel->verticesNum].y = yCoord;
+        dcel->verticesNum++;
+    }
 
-    /* Create edge and its corresponding half-edge */
+    /* Create edge and its corresponding half-edges, the one inside the polygon and its twin outside */
+    growDcel(dcel, 0, dcel->verticesNum, FACE);
     dcel->edgesNum = dcel->verticesNum;
-    dcel->edges = (edge_t *) malloc((dcel->edgesNum) * sizeof(edge_t));
     for (int i = 0; i < dcel->edgesNum; i++) {
-        dcel->edges[i].halfEdge = (halfedge_t *)malloc(sizeof(halfedge_t)); 
-        assert(dcel->edges[i].halfEdge);
-        dcel->edges[i].halfEdge->startVertexIdx = i;
-        dcel->edges[i].halfEdge->endVertexIdx = (i + 1) % (dcel->verticesNum);
-        dcel->edges[i].halfEdge->faceIdx = 0;
-        dcel->edges[i].halfEdge->edgeIdx = i;
-        dcel->edges[i].halfEdge->twin = NULL;
-        dcel->edges[i].halfEdge->next = NULL;
-        dcel->edges[i].halfEdge->prev = NULL;         
-    }
-
-    /* Link each halfEdge to its next and previous halfEdges */
-    for (int i = 0; i < dcel->verticesNum; i++) {
-        dcel->edges[i].halfEdge->next = dcel->edges[(i + 1) % (dcel->verticesNum)].halfEdge;
-        dcel->edges[i].halfEdge->prev = dcel->edges[(i + ((dcel->verticesNum) - 1)) % (dcel->verticesNum)].halfEdge;
+        int next = (i + 1) % (dcel->verticesNum), prev = (i + ((dcel->verticesNum) - 1)) % (dcel->verticesNum);
+        halfedge_t *inside = &(dcel->halfEdges[2 * i]), *outside = &(dcel->halfEdges[TWIN(2 * i)]);
+
+        dcel->edges[i].halfEdge = 2 * i;
+        inside->startVertexIdx = i;
+        inside->endVertexIdx = next;
+        inside->faceIdx = 0;
+        inside->edgeIdx = i;
+        inside->next = 2 * next;
+        inside->prev = 2 * prev;
+
+        /* The outside half-edges run around the polygon the other way */
+        outside->startVertexIdx = next;
+        outside->endVertexIdx = i;
+        outside->faceIdx = NO_FACE;
+        outside->edgeIdx = i;
+        outside->next = TWIN(2 * prev);
+        outside->prev = TWIN(2 * next);
     }
 
     /* Intitially, there is only face 0 and it will point to the first halfedge */
-    dcel->faces = (face_t *) malloc (FACE * sizeof(face_t));
-    assert(dcel->faces);
     dcel->faces[0].halfEdge = dcel->edges[0].halfEdge;
+    dcel->faces[0].halfEdgesNum = dcel->verticesNum;
+    dcel->faces[0].stamp = 0;
+    dcel->changesNum = 0;
     dcel->facesNum = FACE;
 
-    return dcel;
+    /* No checkpoints yet, so splits are not journalled, the journal keeps its space */
+    dcel->isJournaling = 0;
+    dcel->journalNum = 0;
+    dcel->checkpointsNum = 0;
+}
+
+/* Grow a capacity geometrically until it holds needed elements, but never past limit so the indices of the
+   array fit in an int. Returns 1 if it changed, exits if needed is past limit */
+static int grow(int *max, long long needed, int limit, char *what) {
+
+    long long size = *max < 1 ? 1 : *max;
+
+    if (needed > limit) {
+        fprintf(stderr, "Cannot hold %lld %s, at most %d fit\n", needed, what, limit);
+        exit(EXIT_FAILURE);
+    }
+    while (size < needed) {
+        size *= 2;
+    }
+    size = size < limit ? size : limit;
+    if (size == *max) {
+        return 0;
+    }
+    *max = (int) size;
+    return 1;
+}
+
+/* Make sure vertices, edges and faces of the dcel have space for the given number of extra elements */
+void growDcel(dcel_t *dcel, long long extraVertices, long long extraEdges, long long extraFaces) {
+
+    if (grow(&(dcel->maxVertices), dcel->verticesNum + extraVertices, INT_MAX, "vertices")) {
+        dcel->vertices = realloc(dcel->vertices, dcel->maxVertices * sizeof(vertex_t));
+        assert(dcel->vertices);
+        dcel->allocations++;
+    }
+    if (grow(&(dcel->maxEdges), dcel->edgesNum + extraEdges, INT_MAX / 2, "edges")) {
+        dcel->edges = realloc(dcel->edges, dcel->maxEdges * sizeof(edge_t));
+        assert(dcel->edges);
+        dcel->halfEdges = realloc(dcel->halfEdges, 2 * dcel->maxEdges * sizeof(halfedge_t));
+        assert(dcel->halfEdges);
+        dcel->allocations += 2;
+    }
+    if (grow(&(dcel->maxFaces), dcel->facesNum + extraFaces, INT_MAX, "faces")) {
+        dcel->faces = realloc(dcel->faces, dcel->maxFaces * sizeof(face_t));
+        assert(dcel->faces);
+        dcel->allocations++;
+    }
+}
+
+/* Make sure the journal has space for the given number of extra split records */
+static void growJournal(dcel_t *dcel, long long extraRecords) {
+
+    if (grow(&(dcel->maxJournal), dcel->journalNum + extraRecords, INT_MAX, "split records")) {
+        dcel->journal = realloc(dcel->journal, dcel->maxJournal * sizeof(splitRecord_t));
+        assert(dcel->journal);
+        dcel->allocations++;
+    }
+}
+
+/* Reserve space for a known number of splits, so applying them does not reallocate */
+void reserveDcel(dcel_t *dcel, int splitsNum) {
+
+    growDcel(dcel, (long long) splitsNum * EXTRA_VERTICES, (long long) splitsNum * EXTRA_EDGES,
+             (long long) splitsNum * EXTRA_FACE);
+    if (dcel->isJournaling) {
+        growJournal(dcel, splitsNum);
+    }
 }
 
 /* Calculate midpoint of an edge with given end vertex and start vertex */
@@ -90,6 +172,7 @@ int isOfHalfPlane(halfedge_t *halfEdge, vertex_t *vertices, double targetX, doub
     double xStart = vertices[halfEdge->startVertexIdx].x, yStart = vertices[halfEdge->startVertexIdx].y;
     double xEnd = vertices[halfEdge->endVertexIdx].x, yEnd = vertices[halfEdge->endVertexIdx].y;
 
+    STATS_COUNT(halfPlaneTests, 1);
     if ((fabs(xStart - xEnd) < EPSILON) && yStart < yEnd && targetX > xStart) {
         isOfHalfPlane = 1;
     } 
@@ -118,243 +201,659 @@ int isOfHalfPlane(halfedge_t *halfEdge, vertex_t *vertices, double targetX, doub
     return isOfHalfPlane;
 }
 
-/* Perform split on polygon with split read from file */
-void split(dcel_t *dcel) {
+/* Check if a given point lies in a face, i.e. is of half-plane of every half-edge in it */
+int isInFace(dcel_t *dcel, int faceIdx, double targetX, double targetY) {
+
+    int start = dcel->faces[faceIdx].halfEdge, tmp = start;
+
+    do {
+        if (!isOfHalfPlane(&(dcel->halfEdges[tmp]), dcel->vertices, targetX, targetY)) {
+            return 0;
+        }
+        tmp = dcel->halfEdges[tmp].next;
+    } while (tmp != start);
+
+    return 1;
+}
+
+/* Choose the half-edges of two edges that border the same face, outside half-edges never match a face.
+   Returns that face, or NO_FACE if the edges do not share one */
+static int chooseHalfEdges(dcel_t *dcel, int startSplit, int endSplit, int *startHalfEdge, int *endHalfEdge) {
+
+    halfedge_t *halfEdges = dcel->halfEdges;
+
+    *startHalfEdge = dcel->edges[startSplit].halfEdge;
+    *endHalfEdge = dcel->edges[endSplit].halfEdge;
+
+    if (halfEdges[*startHalfEdge].faceIdx == halfEdges[*endHalfEdge].faceIdx) {
+        /* Both half-edges already border the same face */
+    } else if (halfEdges[TWIN(*startHalfEdge)].faceIdx == halfEdges[*endHalfEdge].faceIdx) {
+        *startHalfEdge = TWIN(*startHalfEdge);
+    } else if (halfEdges[TWIN(*endHalfEdge)].faceIdx == halfEdges[*startHalfEdge].faceIdx) {
+        *endHalfEdge = TWIN(*endHalfEdge);
+    } else {
+        *startHalfEdge = TWIN(*startHalfEdge);
+        *endHalfEdge = TWIN(*endHalfEdge);
+    }
+
+    if (halfEdges[*startHalfEdge].faceIdx != halfEdges[*endHalfEdge].faceIdx) {
+        return NO_FACE;
+    }
+    return halfEdges[*startHalfEdge].faceIdx;
+}
+
+/* Record what splitting at two chosen half-edges is about to overwrite, before it does */
+static void journalSplit(dcel_t *dcel, splitRecord_t *record, int startHalfEdge, int endHalfEdge,
+                         int newStartVertexIdx, int newEdgeIdx, int newFaceIdx) {
+
+    halfedge_t *halfEdges = dcel->halfEdges;
+    int faces[3] = {halfEdges[startHalfEdge].faceIdx, halfEdges[TWIN(startHalfEdge)].faceIdx,
+                    halfEdges[TWIN(endHalfEdge)].faceIdx};
+
+    record->verticesNum = newStartVertexIdx;
+    record->edgesNum = newEdgeIdx;
+    record->facesNum = newFaceIdx;
+    record->splitFace = faces[0];
+    record->startHalfEdge = startHalfEdge;
+    record->endHalfEdge = endHalfEdge;
+    record->endOfStart = halfEdges[startHalfEdge].endVertexIdx;
+    record->startOfEnd = halfEdges[endHalfEdge].startVertexIdx;
+    record->startNext = halfEdges[startHalfEdge].next;
+    record->endPrev = halfEdges[endHalfEdge].prev;
+    record->startTwinPrev = halfEdges[TWIN(startHalfEdge)].prev;
+    record->endTwinNext = halfEdges[TWIN(endHalfEdge)].next;
+    for (int k = 0; k < 3; k++) {
+        if (faces[k] != NO_FACE) {
+            record->faces[k] = dcel->faces[faces[k]];
+        }
+    }
+}
+
+/* Undo the last split made, given its record. Half-edges relabelled to the new face go back to the split
+   face, walking only the new face as the split did, then the old links, vertices and faces are put back
+   and the new elements dropped by restoring the counts. The twins of the split half-edges are the ends of
+   their old neighbours, and start and end where the split half-edges ended, so no more is recorded */
+static void undoSplit(dcel_t *dcel, splitRecord_t *record) {
+
+    halfedge_t *halfEdges = dcel->halfEdges;
+    int startHalfEdge = record->startHalfEdge, endHalfEdge = record->endHalfEdge;
+    int start = dcel->faces[record->facesNum].halfEdge, tmp = start;
+    int startTwinFace = halfEdges[TWIN(startHalfEdge)].faceIdx, endTwinFace = halfEdges[TWIN(endHalfEdge)].faceIdx;
+
+    do {
+        if (tmp < 2 * record->edgesNum) {
+            halfEdges[tmp].faceIdx = record->splitFace;
+        }
+        tmp = halfEdges[tmp].next;
+    } while (tmp != start);
+
+    halfEdges[startHalfEdge].endVertexIdx = record->endOfStart;
+    halfEdges[startHalfEdge].next = record->startNext;
+    halfEdges[record->startNext].prev = startHalfEdge;
+    halfEdges[endHalfEdge].startVertexIdx = record->startOfEnd;
+    halfEdges[endHalfEdge].prev = record->endPrev;
+    halfEdges[record->endPrev].next = endHalfEdge;
+    halfEdges[TWIN(startHalfEdge)].startVertexIdx = record->endOfStart;
+    halfEdges[TWIN(startHalfEdge)].prev = record->startTwinPrev;
+    halfEdges[record->startTwinPrev].next = TWIN(startHalfEdge);
+    halfEdges[TWIN(endHalfEdge)].endVertexIdx = record->startOfEnd;
+    halfEdges[TWIN(endHalfEdge)].next = record->endTwinNext;
+    halfEdges[record->endTwinNext].prev = TWIN(endHalfEdge);
+
+    /* Both twins may border the same face, each copy holds it as it was */
+    if (endTwinFace != NO_FACE) {
+        dcel->faces[endTwinFace] = record->faces[2];
+    }
+    if (startTwinFace != NO_FACE) {
+        dcel->faces[startTwinFace] = record->faces[1];
+    }
+    dcel->faces[record->splitFace] = record->faces[0];
+
+    dcel->verticesNum = record->verticesNum;
+    dcel->edgesNum = record->edgesNum;
+    dcel->facesNum = record->facesNum;
+}
 
-    int startSplit, endSplit, splitFace, newStartVertexIdx, newEndVertexIdx, newEdgeIdx, newFaceIdx, 
-        oldEndOfStart, oldStartOfEnd, isAdjacent, oldStartOfStartTwin, oldEndOfEndTwin;
+/* Split the face of two chosen half-edges by joining their midpoints, storing the new vertices, edges and
+   face at the given indices, which must already have space. Every face it changes is stamped with the
+   given stamp, the counts are left to the caller. What it overwrites goes into the record if there is one */
+static void splitFaceAt(dcel_t *dcel, int startHalfEdge, int endHalfEdge, int newStartVertexIdx, int newEdgeIdx,
+                        int newFaceIdx, int stamp, splitRecord_t *record) {
+
+    int splitFace, newEndVertexIdx, oldEndOfStart, oldStartOfEnd, isAdjacent, oldStartOfStartTwin, oldEndOfEndTwin;
+    int oldStartHalfEdgeNext, oldEndHalfEdgePrev, joiningHalfEdge, otherStartHalfEdge, 
+        otherEndHalfEdge, joiningHalfEdgeTwin, startHalfEdgeTwin, endHalfEdgeTwin, startHalfEdgeTwinOther, 
+        endHalfEdgeTwinOther, oldStartHalfEdgeTwinPrev, oldEndHalfEdgeTwinNext, tmp, other, newSide, oldSide,
+        newHalfEdgesNum, splitHalfEdgesNum;
     vertex_t midStartHalfEdge, midEndHalfEdge; 
-    halfedge_t *startHalfEdge = NULL, *endHalfEdge = NULL, *oldStartHalfEdgeNext = NULL, *oldEndHalfEdgePrev = NULL, 
-               *joiningHalfEdge = NULL, *otherStartHalfEdge = NULL, *otherEndHalfEdge = NULL, *joiningHalfEdgeTwin = NULL, 
-               *oldStartHalfEdgeTwinPrev = NULL, *oldEndHalfEdgeTwinNext = NULL, *tmp = NULL;
+    halfedge_t *halfEdges = dcel->halfEdges;
 
-    /* Process the split */
-    while (scanf("%d %d", &startSplit, &endSplit) == 2) {
+    if (record != NULL) {
+        journalSplit(dcel, record, startHalfEdge, endHalfEdge, newStartVertexIdx, newEdgeIdx, newFaceIdx);
+    }
 
-        isAdjacent = 0;
+    isAdjacent = 0;
+    newEndVertexIdx = newStartVertexIdx + 1;
+    splitFace = halfEdges[startHalfEdge].faceIdx;
 
-        /* Set new index for vertices, edges and faces */
-        newStartVertexIdx = dcel->verticesNum;
-        newEndVertexIdx = dcel->verticesNum + 1;
-        newEdgeIdx = dcel->edgesNum;
-        newFaceIdx = dcel->facesNum;  
+    /* Create new vertices */
+    midStartHalfEdge = midPoint(dcel->vertices[halfEdges[startHalfEdge].startVertexIdx],
+                                dcel->vertices[halfEdges[startHalfEdge].endVertexIdx]);
+    midEndHalfEdge = midPoint(dcel->vertices[halfEdges[endHalfEdge].startVertexIdx],
+                              dcel->vertices[halfEdges[endHalfEdge].endVertexIdx]);
 
-        /* Allocate extra space to store new vertices, new edges and new face */
-        dcel->vertices = realloc(dcel->vertices, (dcel->verticesNum + EXTRA_VERTICES) * sizeof(vertex_t));
-        assert(dcel->vertices);
-        dcel->edges = realloc(dcel->edges, (dcel->edgesNum + EXTRA_EDGES) * sizeof(edge_t));
-        assert(dcel->edges);
-        dcel->faces = realloc(dcel->faces, (dcel->facesNum + EXTRA_FACE) * sizeof(face_t));
-        assert(dcel->faces);
+    if (halfEdges[startHalfEdge].next == endHalfEdge) {
+        isAdjacent = 1;
+    }
 
-        /* Create new vertices */
-        midStartHalfEdge = midPoint(dcel->vertices[dcel->edges[startSplit].halfEdge->startVertexIdx],
-                                    dcel->vertices[dcel->edges[startSplit].halfEdge->endVertexIdx]);
-        midEndHalfEdge = midPoint(dcel->vertices[dcel->edges[endSplit].halfEdge->startVertexIdx],
-                                  dcel->vertices[dcel->edges[endSplit].halfEdge->endVertexIdx]);
-
-        /* Choose the correct half-edges for the split */
-        if (dcel->edges[startSplit].halfEdge->faceIdx == dcel->edges[endSplit].halfEdge->faceIdx) {
-            startHalfEdge = dcel->edges[startSplit].halfEdge;
-            endHalfEdge = dcel->edges[endSplit].halfEdge;    
-        } else if (dcel->edges[startSplit].halfEdge->twin != NULL && 
-                   dcel->edges[startSplit].halfEdge->twin->faceIdx == dcel->edges[endSplit].halfEdge->faceIdx) {
-            startHalfEdge = dcel->edges[startSplit].halfEdge->twin; 
-            endHalfEdge = dcel->edges[endSplit].halfEdge;
-        } else if (dcel->edges[endSplit].halfEdge->twin != NULL && 
-                   dcel->edges[endSplit].halfEdge->twin->faceIdx == dcel->edges[startSplit].halfEdge->faceIdx) {
-            startHalfEdge = dcel->edges[startSplit].halfEdge;
-            endHalfEdge = dcel->edges[endSplit].halfEdge->twin;
-        } else {
-            startHalfEdge = dcel->edges[startSplit].halfEdge->twin;
-            endHalfEdge = dcel->edges[endSplit].halfEdge->twin;
+    /* New half-edges take the slots of the three new edges */
+    joiningHalfEdge = 2 * newEdgeIdx;
+    joiningHalfEdgeTwin = TWIN(joiningHalfEdge);
+    otherStartHalfEdge = 2 * (newEdgeIdx + 1);
+    startHalfEdgeTwinOther = TWIN(otherStartHalfEdge);
+    otherEndHalfEdge = 2 * (newEdgeIdx + 2);
+    endHalfEdgeTwinOther = TWIN(otherEndHalfEdge);
+    startHalfEdgeTwin = TWIN(startHalfEdge);
+    endHalfEdgeTwin = TWIN(endHalfEdge);
+
+    /* Store anything that will be updated */
+    oldEndOfStart = halfEdges[startHalfEdge].endVertexIdx; 
+    oldStartOfEnd = halfEdges[endHalfEdge].startVertexIdx; 
+    oldStartHalfEdgeNext = halfEdges[startHalfEdge].next; 
+    oldEndHalfEdgePrev = halfEdges[endHalfEdge].prev; 
+    oldStartOfStartTwin = halfEdges[startHalfEdgeTwin].startVertexIdx;
+    oldStartHalfEdgeTwinPrev = halfEdges[startHalfEdgeTwin].prev;
+    
+    /* Update end point of start half-edge and start point of end half-edge */
+    halfEdges[startHalfEdge].endVertexIdx = newStartVertexIdx;
+    halfEdges[endHalfEdge].startVertexIdx = newEndVertexIdx;
+
+    /* Create new joining half-edge */
+    halfEdges[joiningHalfEdge].startVertexIdx = newStartVertexIdx;
+    halfEdges[joiningHalfEdge].endVertexIdx = newEndVertexIdx;
+    halfEdges[joiningHalfEdge].faceIdx = splitFace;
+    halfEdges[joiningHalfEdge].edgeIdx = newEdgeIdx;
+    halfEdges[joiningHalfEdge].next = endHalfEdge;
+    halfEdges[joiningHalfEdge].prev = startHalfEdge;
+  
+    /* Update pointers of start half-edge and end half-edge in dcel */
+    halfEdges[startHalfEdge].next = joiningHalfEdge;
+    halfEdges[endHalfEdge].prev = joiningHalfEdge;
+    
+    /* Create a twin for the joining half-edge */
+    halfEdges[joiningHalfEdgeTwin].startVertexIdx = newEndVertexIdx;
+    halfEdges[joiningHalfEdgeTwin].endVertexIdx = newStartVertexIdx;      
+    halfEdges[joiningHalfEdgeTwin].edgeIdx = newEdgeIdx;
+    halfEdges[joiningHalfEdgeTwin].faceIdx = splitFace;
+    
+    /* Create other halfs of the start half-edge and the old half-edge */ 
+    halfEdges[otherStartHalfEdge].startVertexIdx = newStartVertexIdx;
+    halfEdges[otherStartHalfEdge].endVertexIdx = oldEndOfStart;
+    halfEdges[otherStartHalfEdge].faceIdx = splitFace;
+    halfEdges[otherStartHalfEdge].edgeIdx = newEdgeIdx + 1;
+    halfEdges[otherStartHalfEdge].prev = joiningHalfEdgeTwin;
+    if (isAdjacent) {
+        halfEdges[otherStartHalfEdge].next = otherEndHalfEdge;
+    } else {
+        halfEdges[otherStartHalfEdge].next = oldStartHalfEdgeNext;
+        halfEdges[oldStartHalfEdgeNext].prev = otherStartHalfEdge;
+    }
+     
+    halfEdges[otherEndHalfEdge].startVertexIdx = oldStartOfEnd;
+    halfEdges[otherEndHalfEdge].endVertexIdx = newEndVertexIdx;
+    halfEdges[otherEndHalfEdge].faceIdx = splitFace;
+    halfEdges[otherEndHalfEdge].edgeIdx = newEdgeIdx + 2;
+    halfEdges[otherEndHalfEdge].next = joiningHalfEdgeTwin;
+    if (isAdjacent) {
+        halfEdges[otherEndHalfEdge].prev = otherStartHalfEdge;
+    } else {
+        halfEdges[otherEndHalfEdge].prev = oldEndHalfEdgePrev;
+        halfEdges[oldEndHalfEdgePrev].next = otherEndHalfEdge;
+    }      
+
+    /* Connect the twin of the joining half-edge with them */
+    halfEdges[joiningHalfEdgeTwin].next = otherStartHalfEdge;
+    halfEdges[joiningHalfEdgeTwin].prev = otherEndHalfEdge; 
+
+    /* Work with twin of start half-edge, which may lie outside the polygon */
+    halfEdges[startHalfEdgeTwin].startVertexIdx = newStartVertexIdx;
+    halfEdges[startHalfEdgeTwin].prev = startHalfEdgeTwinOther;
+    halfEdges[startHalfEdgeTwinOther].startVertexIdx = oldStartOfStartTwin;
+    halfEdges[startHalfEdgeTwinOther].endVertexIdx = newStartVertexIdx;
+    halfEdges[startHalfEdgeTwinOther].faceIdx = halfEdges[startHalfEdgeTwin].faceIdx;
+    halfEdges[startHalfEdgeTwinOther].edgeIdx = newEdgeIdx + 1;
+    halfEdges[startHalfEdgeTwinOther].next = startHalfEdgeTwin;
+    halfEdges[startHalfEdgeTwinOther].prev = oldStartHalfEdgeTwinPrev;
+    halfEdges[oldStartHalfEdgeTwinPrev].next = startHalfEdgeTwinOther;
+    if (halfEdges[startHalfEdgeTwin].faceIdx != NO_FACE) {
+        dcel->faces[halfEdges[startHalfEdgeTwin].faceIdx].halfEdge = startHalfEdgeTwin;
+        dcel->faces[halfEdges[startHalfEdgeTwin].faceIdx].halfEdgesNum++;
+        dcel->faces[halfEdges[startHalfEdgeTwin].faceIdx].stamp = stamp;
+    }
+
+    /* Work with twin of end half-edge, read after the start twin in case they are neighbours */
+    oldEndOfEndTwin = halfEdges[endHalfEdgeTwin].endVertexIdx;
+    oldEndHalfEdgeTwinNext = halfEdges[endHalfEdgeTwin].next;
+    halfEdges[endHalfEdgeTwin].endVertexIdx = newEndVertexIdx;
+    halfEdges[endHalfEdgeTwin].next = endHalfEdgeTwinOther;
+    halfEdges[endHalfEdgeTwinOther].startVertexIdx = newEndVertexIdx;
+    halfEdges[endHalfEdgeTwinOther].endVertexIdx = oldEndOfEndTwin;
+    halfEdges[endHalfEdgeTwinOther].faceIdx = halfEdges[endHalfEdgeTwin].faceIdx;
+    halfEdges[endHalfEdgeTwinOther].edgeIdx = newEdgeIdx + 2;
+    halfEdges[endHalfEdgeTwinOther].next = oldEndHalfEdgeTwinNext;
+    halfEdges[endHalfEdgeTwinOther].prev = endHalfEdgeTwin;
+    halfEdges[oldEndHalfEdgeTwinNext].prev = endHalfEdgeTwinOther;
+    if (halfEdges[endHalfEdgeTwin].faceIdx != NO_FACE) {
+        dcel->faces[halfEdges[endHalfEdgeTwin].faceIdx].halfEdge = endHalfEdgeTwin;
+        dcel->faces[halfEdges[endHalfEdgeTwin].faceIdx].halfEdgesNum++;
+        dcel->faces[halfEdges[endHalfEdgeTwin].faceIdx].stamp = stamp;
+    }
+
+    /* Update original dcel with new vertices */
+    dcel->vertices[newStartVertexIdx] = midStartHalfEdge;
+    dcel->vertices[newEndVertexIdx] = midEndHalfEdge;
+
+    /* Update original dcel with new edges, each pointing at its half-edge inside the split face */
+    dcel->edges[newEdgeIdx].halfEdge = joiningHalfEdge;
+    dcel->edges[newEdgeIdx + 1].halfEdge = otherStartHalfEdge;
+    dcel->edges[newEdgeIdx + 2].halfEdge = otherEndHalfEdge;
+
+    /* Both sides are labelled with the split face so far. Walk the two cycles together until the shorter
+       one closes, and relabel only that one as the new face, so a split costs time in proportion to the
+       smaller side. On a tie the side of the joining twin becomes the new face */
+    splitHalfEdgesNum = dcel->faces[splitFace].halfEdgesNum + 4;
+    newHalfEdgesNum = 1;
+    tmp = halfEdges[joiningHalfEdge].next;
+    other = halfEdges[joiningHalfEdgeTwin].next;
+    while (tmp != joiningHalfEdge && other != joiningHalfEdgeTwin) {
+        tmp = halfEdges[tmp].next;
+        other = halfEdges[other].next;
+        newHalfEdgesNum++;
+    }
+    newSide = other == joiningHalfEdgeTwin ? joiningHalfEdgeTwin : joiningHalfEdge;
+    STATS_WALK(splitWalks, newHalfEdgesNum);
+    oldSide = TWIN(newSide);
+
+    /* Update old face */
+    dcel->faces[splitFace].halfEdge = oldSide;
+    dcel->faces[splitFace].halfEdgesNum = splitHalfEdgesNum - newHalfEdgesNum;
+    dcel->faces[splitFace].stamp = stamp;
+
+    /* Update new face and all half edges in new face */
+    dcel->faces[newFaceIdx].halfEdge = newSide;
+    dcel->faces[newFaceIdx].halfEdgesNum = newHalfEdgesNum;
+    dcel->faces[newFaceIdx].stamp = stamp;
+
+    tmp = newSide;
+    do {
+        halfEdges[tmp].faceIdx = newFaceIdx;
+        tmp = halfEdges[tmp].next;
+    } while (tmp != newSide);
+}
+
+/* Split the face shared by two edges by joining their midpoints. Returns the index of the split face,
+   which keeps the longer side, while the shorter side becomes face facesNum - 1. Returns NO_FACE without
+   changing anything if the edges do not exist or do not share a face */
+int applySplit(dcel_t *dcel, int startSplit, int endSplit) {
+
+    int splitFace, startHalfEdge, endHalfEdge;
+    splitRecord_t *record = NULL;
+
+    if (startSplit < 0 || startSplit >= dcel->edgesNum || endSplit < 0 || endSplit >= dcel->edgesNum || 
+        startSplit == endSplit) {
+        return NO_FACE;
+    }
+
+    splitFace = chooseHalfEdges(dcel, startSplit, endSplit, &startHalfEdge, &endHalfEdge);
+    if (splitFace == NO_FACE) {
+        return NO_FACE;
+    }
+
+    /* Make sure there is space to store new vertices, new edges and new face */
+    growDcel(dcel, EXTRA_VERTICES, EXTRA_EDGES, EXTRA_FACE);
+    if (dcel->isJournaling) {
+        growJournal(dcel, 1);
+        record = &(dcel->journal[dcel->journalNum++]);
+    }
+    dcel->changesNum++;
+    splitFaceAt(dcel, startHalfEdge, endHalfEdge, dcel->verticesNum, dcel->edgesNum, dcel->facesNum,
+                dcel->changesNum, record);
+    dcel->verticesNum += EXTRA_VERTICES;
+    dcel->edgesNum += EXTRA_EDGES;
+    dcel->facesNum += EXTRA_FACE;
+
+    return splitFace;
+}
+
+/* Splits of one wave, each with its chosen half-edges, and the counts of the dcel before the wave */
+typedef struct {
+    dcel_t *dcel;
+    int splitsNum;
+    int *startHalfEdges;
+    int *endHalfEdges;
+    int verticesNum, edgesNum, facesNum;
+    int journalNum;
+    int changesNum;
+} wave_t;
+
+/* Apply one block of the splits of a wave. Split k of the wave takes the indices, stamp and journal record it
+   would have taken applied alone, right after the k splits before it */
+static void applyWaveTask(void *arg, int taskIdx, int threadIdx) {
+
+    wave_t *wave = (wave_t *) arg;
+    int start = taskIdx * WAVE_TASK, end = start + WAVE_TASK;
+
+    if (end > wave->splitsNum) {
+        end = wave->splitsNum;
+    }
+    for (int k = start; k < end; k++) {
+        splitFaceAt(wave->dcel, wave->startHalfEdges[k], wave->endHalfEdges[k],
+                    wave->verticesNum + k * EXTRA_VERTICES, wave->edgesNum + k * EXTRA_EDGES,
+                    wave->facesNum + k * EXTRA_FACE, wave->changesNum + k + 1,
+                    wave->dcel->isJournaling ? &(wave->dcel->journal[wave->journalNum + k]) : NULL);
+    }
+}
+
+/* Claim the faces and edges a split writes to for the current wave, returns 0 without claiming anything if
+   an earlier split of the wave holds one of them. A split rewrites its own face and whole faces on the
+   other side of both edges. Outside the polygon it only touches both edges and the neighbours of their
+   outside halves */
+static int claimSplit(dcel_t *dcel, int *faceWaves, int *edgeWaves, int waveIdx, int startHalfEdge,
+                      int endHalfEdge) {
+
+    halfedge_t *halfEdges = dcel->halfEdges;
+    int faces[3], edges[4], facesNum = 0, edgesNum = 0;
+
+    faces[facesNum++] = halfEdges[startHalfEdge].faceIdx;
+    edges[edgesNum++] = startHalfEdge / 2;
+    edges[edgesNum++] = endHalfEdge / 2;
+    if (halfEdges[TWIN(startHalfEdge)].faceIdx != NO_FACE) {
+        faces[facesNum++] = halfEdges[TWIN(startHalfEdge)].faceIdx;
+    } else {
+        edges[edgesNum++] = halfEdges[TWIN(startHalfEdge)].prev / 2;
+    }
+    if (halfEdges[TWIN(endHalfEdge)].faceIdx != NO_FACE) {
+        faces[facesNum++] = halfEdges[TWIN(endHalfEdge)].faceIdx;
+    } else {
+        edges[edgesNum++] = halfEdges[TWIN(endHalfEdge)].next / 2;
+    }
+
+    for (int i = 0; i < facesNum; i++) {
+        if (faceWaves[faces[i]] == waveIdx) {
+            return 0;
+        }
+    }
+    for (int i = 0; i < edgesNum; i++) {
+        if (edgeWaves[edges[i]] == waveIdx) {
+            return 0;
         }
+    }
+    for (int i = 0; i < facesNum; i++) {
+        faceWaves[faces[i]] = waveIdx;
+    }
+    for (int i = 0; i < edgesNum; i++) {
+        edgeWaves[edges[i]] = waveIdx;
+    }
+    return 1;
+}
 
-        splitFace = startHalfEdge->faceIdx;
+/* Apply an array of splits, reserving space for all of them up front. Returns the number of valid splits.
+   Over several threads the splits are cut into waves: a wave takes splits in order for as long as each
+   touches only faces and edges no earlier split of the wave touches, then applies them all in parallel.
+   Every split in a wave sees the same dcel it would have seen applied alone, so the result is the same as
+   applying them one by one, down to the numbering of vertices, edges and faces */
+int applySplits(dcel_t *dcel, splitPair_t *splits, int splitsNum, int threadsNum) {
+
+    int appliedNum = 0, waveIdx = 0, i = 0, startSplit, endSplit, startHalfEdge, endHalfEdge;
+    int *faceWaves = NULL, *edgeWaves = NULL;
+    wave_t wave;
+
+    reserveDcel(dcel, splitsNum);
+    if (threadsNum <= 1) {
+        for (i = 0; i < splitsNum; i++) {
+            if (applySplit(dcel, splits[i].startEdge, splits[i].endEdge) != NO_FACE) {
+                appliedNum++;
+            }
+        }
+        return appliedNum;
+    }
 
-        if (startHalfEdge->next == endHalfEdge) {
-            isAdjacent = 1;
+    faceWaves = (int *) calloc(dcel->maxFaces, sizeof(int));
+    assert(faceWaves);
+    edgeWaves = (int *) calloc(dcel->maxEdges, sizeof(int));
+    assert(edgeWaves);
+    wave.dcel = dcel;
+    wave.startHalfEdges = (int *) malloc(splitsNum * sizeof(int));
+    assert(wave.startHalfEdges);
+    wave.endHalfEdges = (int *) malloc(splitsNum * sizeof(int));
+    assert(wave.endHalfEdges);
+
+    while (i < splitsNum) {
+        waveIdx++;
+        wave.splitsNum = 0;
+        wave.verticesNum = dcel->verticesNum;
+        wave.edgesNum = dcel->edgesNum;
+        wave.facesNum = dcel->facesNum;
+        wave.journalNum = dcel->journalNum;
+        wave.changesNum = dcel->changesNum;
+
+        /* Take splits until one depends on an earlier split of the wave */
+        for (; i < splitsNum; i++) {
+            startSplit = splits[i].startEdge;
+            endSplit = splits[i].endEdge;
+            if (startSplit < 0 || endSplit < 0 || startSplit == endSplit) {
+                continue;
+            }
+            if (startSplit >= wave.edgesNum || endSplit >= wave.edgesNum) {
+                /* The edge may be made by this wave, and does not exist if nothing was taken yet */
+                if (wave.splitsNum > 0) {
+                    break;
+                }
+                continue;
+            }
+            if (edgeWaves[startSplit] == waveIdx || edgeWaves[endSplit] == waveIdx ||
+                (dcel->halfEdges[2 * startSplit].faceIdx != NO_FACE &&
+                 faceWaves[dcel->halfEdges[2 * startSplit].faceIdx] == waveIdx) ||
+                (dcel->halfEdges[2 * startSplit + 1].faceIdx != NO_FACE &&
+                 faceWaves[dcel->halfEdges[2 * startSplit + 1].faceIdx] == waveIdx) ||
+                (dcel->halfEdges[2 * endSplit].faceIdx != NO_FACE &&
+                 faceWaves[dcel->halfEdges[2 * endSplit].faceIdx] == waveIdx) ||
+                (dcel->halfEdges[2 * endSplit + 1].faceIdx != NO_FACE &&
+                 faceWaves[dcel->halfEdges[2 * endSplit + 1].faceIdx] == waveIdx)) {
+                break;
+            }
+            if (chooseHalfEdges(dcel, startSplit, endSplit, &startHalfEdge, &endHalfEdge) == NO_FACE) {
+                continue;
+            }
+            if (!claimSplit(dcel, faceWaves, edgeWaves, waveIdx, startHalfEdge, endHalfEdge)) {
+                break;
+            }
+            wave.startHalfEdges[wave.splitsNum] = startHalfEdge;
+            wave.endHalfEdges[wave.splitsNum] = endHalfEdge;
+            wave.splitsNum++;
         }
 
-        /* Store anything that will be updated */
-        oldEndOfStart = startHalfEdge->endVertexIdx; 
-        oldStartOfEnd = endHalfEdge->startVertexIdx; 
-        oldStartHalfEdgeNext = startHalfEdge->next; 
-        oldEndHalfEdgePrev = endHalfEdge->prev; 
-        if (startHalfEdge->twin != NULL) {
-            oldStartOfStartTwin = startHalfEdge->twin->startVertexIdx;
-            oldStartHalfEdgeTwinPrev = startHalfEdge->twin->prev;
+        /* A split takes about half a microsecond and waking a pool thread a few, so a task of WAVE_TASK
+           splits is several times what it costs to hand out, and a wave of one task stays on this thread.
+           Split k of the wave takes the change count it would have taken applied alone, so stamps do not
+           depend on the number of threads */
+        parallelFor((wave.splitsNum + WAVE_TASK - 1) / WAVE_TASK, threadsNum, applyWaveTask, &wave);
+        dcel->verticesNum += wave.splitsNum * EXTRA_VERTICES;
+        dcel->edgesNum += wave.splitsNum * EXTRA_EDGES;
+        dcel->facesNum += wave.splitsNum * EXTRA_FACE;
+        if (dcel->isJournaling) {
+            dcel->journalNum += wave.splitsNum;
         }
-        if (endHalfEdge->twin != NULL) {
-            oldEndOfEndTwin = endHalfEdge->twin->endVertexIdx;
-            oldEndHalfEdgeTwinNext = endHalfEdge->twin->next;
+        dcel->changesNum += wave.splitsNum;
+        appliedNum += wave.splitsNum;
+    }
+
+    free(faceWaves);
+    free(edgeWaves);
+    free(wave.startHalfEdges);
+    free(wave.endHalfEdges);
+    return appliedNum;
+}
+
+/* Start journalling splits if they are not already, and return a checkpoint that rollbackDcel can take the
+   dcel back to. A checkpoint is the number of journalled splits, taking two with no split between them
+   gives the same one */
+int checkpointDcel(dcel_t *dcel) {
+
+    dcel->isJournaling = 1;
+    if (dcel->checkpointsNum == 0 || dcel->checkpoints[dcel->checkpointsNum - 1] != dcel->journalNum) {
+        if (grow(&(dcel->maxCheckpoints), dcel->checkpointsNum + 1LL, INT_MAX, "checkpoints")) {
+            dcel->checkpoints = realloc(dcel->checkpoints, dcel->maxCheckpoints * sizeof(int));
+            assert(dcel->checkpoints);
+            dcel->allocations++;
         }
-        
-        /* Update end point of start half-edge and start point of end half-edge */
-        startHalfEdge->endVertexIdx = newStartVertexIdx;
-        endHalfEdge->startVertexIdx = newEndVertexIdx;
-
-        /* Create new joining half-edge */
-        joiningHalfEdge = (halfedge_t *) malloc(sizeof(halfedge_t));
-        assert(joiningHalfEdge);
-
-        joiningHalfEdge->startVertexIdx = newStartVertexIdx;
-        joiningHalfEdge->endVertexIdx = newEndVertexIdx;
-        joiningHalfEdge->faceIdx = startHalfEdge->faceIdx;
-        joiningHalfEdge->edgeIdx = newEdgeIdx;
-        joiningHalfEdge->next = endHalfEdge;
-        joiningHalfEdge->prev = startHalfEdge;
-      
-        /* Update pointers of start half-edge and end half-edge in dcel */
-        startHalfEdge->next = joiningHalfEdge;
-        endHalfEdge->prev = joiningHalfEdge;
-        
-        /* Create a twin for the joining half-edge */
-        joiningHalfEdgeTwin = (halfedge_t *) malloc(sizeof(halfedge_t));
-        assert(joiningHalfEdgeTwin);
-
-        joiningHalfEdge->twin = joiningHalfEdgeTwin;
-        joiningHalfEdgeTwin->twin = joiningHalfEdge;
-        joiningHalfEdgeTwin->startVertexIdx = joiningHalfEdge->endVertexIdx;
-        joiningHalfEdgeTwin->endVertexIdx = joiningHalfEdge->startVertexIdx;      
-        joiningHalfEdgeTwin->edgeIdx = joiningHalfEdge->edgeIdx;
-        joiningHalfEdgeTwin->faceIdx = newFaceIdx;
-        
-        /* Create other halfs of the start half-edge and the old half-edge */ 
-        otherStartHalfEdge = (halfedge_t *) malloc(sizeof(halfedge_t));
-        assert(otherStartHalfEdge);
-        otherEndHalfEdge = (halfedge_t *) malloc(sizeof(halfedge_t));
-        assert(otherEndHalfEdge);       
-
-        otherStartHalfEdge->startVertexIdx = startHalfEdge->endVertexIdx;
-        otherStartHalfEdge->endVertexIdx = oldEndOfStart;
-        otherStartHalfEdge->edgeIdx = newEdgeIdx + 1;
-        otherStartHalfEdge->twin = NULL;       
-        if (isAdjacent) {
-            otherStartHalfEdge->next = otherEndHalfEdge;
-            otherStartHalfEdge->prev = joiningHalfEdgeTwin;
+        dcel->checkpoints[dcel->checkpointsNum++] = dcel->journalNum;
+    }
+    return dcel->journalNum;
+}
+
+/* Find a checkpoint among those still valid, which are kept in increasing order. Returns its position in
+   the list, -1 if it was never taken or a rollback has since undone it */
+static int findCheckpoint(dcel_t *dcel, int checkpoint) {
+
+    int low = 0, high = dcel->checkpointsNum - 1;
+
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        if (dcel->checkpoints[middle] == checkpoint) {
+            return middle;
+        } else if (dcel->checkpoints[middle] < checkpoint) {
+            low = middle + 1;
         } else {
-            otherStartHalfEdge->next = oldStartHalfEdgeNext;
-            otherStartHalfEdge->prev = joiningHalfEdgeTwin;
-            oldStartHalfEdgeNext->prev = otherStartHalfEdge;
+            high = middle - 1;
         }
-         
-        otherEndHalfEdge->startVertexIdx = oldStartOfEnd;
-        otherEndHalfEdge->endVertexIdx = endHalfEdge->startVertexIdx;
-        otherEndHalfEdge->edgeIdx = newEdgeIdx + 2;
-        otherEndHalfEdge->twin = NULL;
-        if (isAdjacent) {
-            otherEndHalfEdge->next = joiningHalfEdgeTwin;
-            otherEndHalfEdge->prev = otherStartHalfEdge;
-        } else {
-            otherEndHalfEdge->next = joiningHalfEdgeTwin;
-            otherEndHalfEdge->prev = oldEndHalfEdgePrev;
-            oldEndHalfEdgePrev->next = otherEndHalfEdge;
-        }      
-
-        /* Connect the twin of the joining half-edge with them */
-        joiningHalfEdgeTwin->next = otherStartHalfEdge;
-        joiningHalfEdgeTwin->prev = otherEndHalfEdge; 
-
-        /* Work with twin of start half-edge if exists */
-        if (startHalfEdge->twin != NULL) {
-            halfedge_t *startHalfEdgeTwin = startHalfEdge->twin;
-            halfedge_t *startHalfEdgeTwinOther = NULL;      
-
-            /* Update the twin */
-            startHalfEdgeTwin->startVertexIdx = newStartVertexIdx;
-                      
-            /* Create other half of twin */
-            startHalfEdgeTwinOther = (halfedge_t *) malloc(sizeof(halfedge_t));
-            assert(startHalfEdgeTwinOther);
-
-            startHalfEdgeTwin->prev = startHalfEdgeTwinOther;
-            startHalfEdgeTwinOther->startVertexIdx = oldStartOfStartTwin;
-            startHalfEdgeTwinOther->endVertexIdx = newStartVertexIdx;
-            startHalfEdgeTwinOther->faceIdx = startHalfEdgeTwin->faceIdx;
-            startHalfEdgeTwinOther->edgeIdx = otherStartHalfEdge->edgeIdx;
-            startHalfEdgeTwinOther->next = startHalfEdgeTwin;
-            startHalfEdgeTwinOther->prev = oldStartHalfEdgeTwinPrev;
-            startHalfEdgeTwinOther->twin = otherStartHalfEdge;
-
-            /* Update other pointers to other half of start half-edge twin */
-            oldStartHalfEdgeTwinPrev->next = startHalfEdgeTwinOther;
-            otherStartHalfEdge->twin = startHalfEdgeTwinOther;
-
-            /* Update face pointer */
-            dcel->faces[startHalfEdgeTwin->faceIdx].halfEdge = startHalfEdgeTwin;
-        } 
-
-         /* Work with twin of end half-edge if exist */
-        if (endHalfEdge->twin != NULL) {
-            halfedge_t *endHalfEdgeTwin = endHalfEdge->twin;
-            halfedge_t *endHalfEdgeTwinOther = NULL;
-    
-            /* Update the twin */
-            endHalfEdgeTwin->endVertexIdx = newEndVertexIdx;
-                      
-            /* Create other half of twin */
-            endHalfEdgeTwinOther = (halfedge_t *) malloc(sizeof(halfedge_t));
-            assert(endHalfEdgeTwinOther);
-
-            endHalfEdgeTwin->next = endHalfEdgeTwinOther;       
-            endHalfEdgeTwinOther->startVertexIdx = newEndVertexIdx;
-            endHalfEdgeTwinOther->endVertexIdx = oldEndOfEndTwin;
-            endHalfEdgeTwinOther->faceIdx = endHalfEdgeTwin->faceIdx;
-            endHalfEdgeTwinOther->edgeIdx = otherEndHalfEdge->edgeIdx;
-            endHalfEdgeTwinOther->next = oldEndHalfEdgeTwinNext;
-            endHalfEdgeTwinOther->prev = endHalfEdgeTwin;
-            endHalfEdgeTwinOther->twin = otherEndHalfEdge;
-            
-            /* Update other pointers to other half of start half-edge twin */
-            oldEndHalfEdgeTwinNext->prev = endHalfEdgeTwinOther;
-            otherEndHalfEdge->twin = endHalfEdgeTwinOther;
-
-            /* Update face pointer */
-            dcel->faces[endHalfEdgeTwin->faceIdx].halfEdge = endHalfEdgeTwin;
-        } 
-
-        /* Update original dcel with new vertices */
-        dcel->vertices[newStartVertexIdx] = midStartHalfEdge;
-        dcel->vertices[newEndVertexIdx] = midEndHalfEdge;
-        dcel->verticesNum = (dcel->verticesNum) + 2;   
-
-        /* Update original dcel with new edges and halfedges */
-        dcel->edges[newEdgeIdx].halfEdge = joiningHalfEdge;
-        dcel->edges[newEdgeIdx + 1].halfEdge = otherStartHalfEdge;
-        dcel->edges[newEdgeIdx + 2].halfEdge = otherEndHalfEdge;
-        dcel->edgesNum = (dcel->edgesNum) + EXTRA_EDGES;
-
-        /* Update old face and all half edges in old face */
-        dcel->faces[splitFace].halfEdge = joiningHalfEdge;
-        
-        tmp = joiningHalfEdge->next;
-        while (tmp->edgeIdx != joiningHalfEdge->edgeIdx) {
-            tmp->faceIdx = splitFace;
-            tmp = tmp->next;
-        } 
-           
-        /* Update new face and all half edges in new face */
-        dcel->faces[newFaceIdx].halfEdge = joiningHalfEdgeTwin;
-        dcel->facesNum = (dcel->facesNum) + EXTRA_FACE;
-        
-        tmp = joiningHalfEdgeTwin->next;
-        while (tmp->edgeIdx != joiningHalfEdgeTwin->edgeIdx) {
-            tmp->faceIdx = newFaceIdx;
-            tmp = tmp->next;
-        } 
-    }
-}   
+    }
+    return -1;
+}
 
-/* Free doubly connected edge list */   
-void freeList(dcel_t *dcel) {
-    
-    for (int i = 0; i < dcel->edgesNum; i++) {
-        if (dcel->edges[i].halfEdge->twin != NULL) {
-            free(dcel->edges[i].halfEdge->twin);
+/* Check if a checkpoint is still valid */
+int isCheckpoint(dcel_t *dcel, int checkpoint) {
+
+    return dcel->isJournaling && findCheckpoint(dcel, checkpoint) >= 0;
+}
+
+/* Undo the last journalled split */
+void undoLastSplit(dcel_t *dcel) {
+
+    undoSplit(dcel, &(dcel->journal[--dcel->journalNum]));
+}
+
+/* Undo every split made since a checkpoint, the last first, in time proportional to the splits undone. The
+   checkpoint and those before it stay valid, later ones are dropped, so once new splits are made their
+   numbers cannot take the dcel to a state it is no longer in. Restored faces take back their old stamps,
+   while the change count keeps counting up, so splits made after the rollback never reuse a stamp and
+   anything cached about a face stays valid exactly when its stamp matches. Returns the number of splits
+   undone, -1 if there is no such checkpoint or it is no longer valid */
+int rollbackDcel(dcel_t *dcel, int checkpoint) {
+
+    int undoneNum, position;
+
+    if (!dcel->isJournaling || (position = findCheckpoint(dcel, checkpoint)) < 0) {
+        return -1;
+    }
+    dcel->checkpointsNum = position + 1;
+    undoneNum = dcel->journalNum - checkpoint;
+    while (dcel->journalNum > checkpoint) {
+        undoLastSplit(dcel);
+    }
+    return undoneNum;
+}
+
+/* Drop every checkpoint and the journal, later splits are not journalled until the next checkpoint */
+void releaseCheckpoints(dcel_t *dcel) {
+
+    free(dcel->journal);
+    dcel->journal = NULL;
+    free(dcel->checkpoints);
+    dcel->checkpoints = NULL;
+    dcel->isJournaling = 0;
+    dcel->journalNum = dcel->maxJournal = 0;
+    dcel->checkpointsNum = dcel->maxCheckpoints = 0;
+}
+
+/* Parse whitespace separated integers into split pairs until the end of text or the first token that is not
+   an integer, carrying a half read pair over in pending. Returns 0 once a bad token is found */
+static int parseSplits(char *text, splitPair_t **splits, int *splitsNum, int *maxSplits, int *pending, int *pendingNum) {
+
+    char *end;
+    long value;
+
+    while (1) {
+        value = strtol(text, &end, 10);
+        if (end == text) {
+            while (isspace((unsigned char) *text)) {
+                text++;
+            }
+            return *text == '\0';
         }
-        free(dcel->edges[i].halfEdge);
+        text = end;
+        if (*pendingNum == 0) {
+            *pending = value;
+            *pendingNum = 1;
+            continue;
+        }
+        if (*splitsNum == *maxSplits) {
+            *maxSplits *= 2;
+            *splits = realloc(*splits, *maxSplits * sizeof(splitPair_t));
+            assert(*splits);
+        }
+        (*splits)[*splitsNum].startEdge = *pending;
+        (*splits)[*splitsNum].endEdge = value;
+        (*splitsNum)++;
+        *pendingNum = 0;
     }
+}
+
+/* Read split pairs from text, stopping at the first malformed pair like scanf would. The text is read in
+   large blocks and parsed in place, cutting each block after its last whitespace so no number is split */
+splitPair_t *readSplits(FILE *file, int *splitsNum) {
+
+    int maxSplits = SPLITS, pending = 0, pendingNum = 0, isEnd = 0, isValid = 1;
+    size_t length = 0, cut;
+    char *buffer, saved;
+    splitPair_t *splits;
+
+    splits = (splitPair_t *) malloc(maxSplits * sizeof(splitPair_t));
+    assert(splits);
+    buffer = (char *) malloc(SPLIT_BLOCK + 1);
+    assert(buffer);
+    *splitsNum = 0;
+
+    while (isValid && !isEnd) {
+        length += fread(buffer + length, 1, SPLIT_BLOCK - length, file);
+        isEnd = length < SPLIT_BLOCK;
+
+        /* Parse up to the last whitespace, or everything at the end of the file */
+        cut = length;
+        if (!isEnd) {
+            while (cut > 0 && !isspace((unsigned char) buffer[cut - 1])) {
+                cut--;
+            }
+            if (cut == 0) {
+                break;
+            }
+        }
+        saved = buffer[cut];
+        buffer[cut] = '\0';
+        isValid = parseSplits(buffer, &splits, splitsNum, &maxSplits, &pending, &pendingNum);
+        buffer[cut] = saved;
+        memmove(buffer, buffer + cut, length - cut);
+        length -= cut;
+    }
+
+    free(buffer);
+    return splits;
+}
+
+/* Free doubly connected edge list */   
+void freeList(dcel_t *dcel) {
+
+    free(dcel->halfEdges);
 
     free(dcel->edges);
 
@@ -362,5 +861,9 @@ void freeList(dcel_t *dcel) {
 
     free(dcel->vertices);
 
+    free(dcel->journal);
+
+    free(dcel->checkpoints);
+
     free(dcel);
 }
@@ -1,44 +1,97 @@
 #ifndef LIST_H
 #define LIST_H
 
-    typedef struct halfEdge halfedge_t;
+    /* Face index of half-edges outside the polygon */
+    #define NO_FACE -1
+
+    /* The two half-edges of edge i are stored in slots 2i and 2i + 1 of the half-edge array */
+    #define TWIN(halfEdgeIdx) ((halfEdgeIdx) ^ 1)
 
     typedef struct {
-        double x; 
+        double x;
         double y;
     } vertex_t;
 
-    struct halfEdge {
+    /* Half-edges refer to each other by their index in the half-edge array of the dcel */
+    typedef struct {
         int startVertexIdx;
         int endVertexIdx;
         int faceIdx;
         int edgeIdx;
-        halfedge_t *next;
-        halfedge_t *prev;
-        halfedge_t *twin;    
-    };
+        int next;
+        int prev;
+    } halfedge_t;
 
     typedef struct {
-        halfedge_t *halfEdge;
+        int halfEdge;
     } edge_t;
 
+    /* A face points at one half-edge of its cycle and knows how many half-edges the cycle has. Its stamp
+       is the change count of the dcel when the cycle last changed, so anything cached about the face can
+       tell whether it is stale */
     typedef struct {
-        halfedge_t *halfEdge;
+        int halfEdge;
+        int halfEdgesNum;
+        int stamp;
     } face_t;
 
+    /* A split from the midpoint of one edge to the midpoint of another */
+    typedef struct {
+        int startEdge;
+        int endEdge;
+    } splitPair_t;
+
+    /* What a split overwrote, enough to undo it: the counts it extended, the split face, the two half-edges
+       it split with the vertices they ended at and their neighbours before the split, and the faces it
+       rewrote, the split face then the faces across the start and end edges. Everything else it changed
+       is either new or a half-edge relabelled to the new face */
+    typedef struct {
+        int verticesNum, edgesNum, facesNum;
+        int splitFace;
+        int startHalfEdge, endHalfEdge;
+        int endOfStart, startOfEnd;
+        int startNext, endPrev, startTwinPrev, endTwinNext;
+        face_t faces[3];
+    } splitRecord_t;
+
+    /* Vertices, edges, half-edges and faces each sit in one array that grows with its max, so a split
+       allocates nothing once space is reserved. allocations counts the allocator calls made for the dcel */
     typedef struct {
         int verticesNum;
         int edgesNum;
         int facesNum;
+        int maxVertices;
+        int maxEdges;
+        int maxFaces;
         vertex_t *vertices;
         edge_t *edges;
-        face_t *faces;   
+        face_t *faces;
+        halfedge_t *halfEdges;
+        long allocations;
+        int changesNum;
+        int isJournaling;
+        int journalNum;
+        int maxJournal;
+        splitRecord_t *journal;
+        int checkpointsNum;
+        int maxCheckpoints;
+        int *checkpoints;
     } dcel_t;
 
-    vertex_t *readVertices(FILE *file, int *currentSize);
     dcel_t *constructInitialDcel(FILE *file);
-    void split(dcel_t *dcel);
+    void resetDcel(dcel_t *dcel, FILE *file);
+    void growDcel(dcel_t *dcel, long long extraVertices, long long extraEdges, long long extraFaces);
+    void reserveDcel(dcel_t *dcel, int splitsNum);
+    int applySplit(dcel_t *dcel, int startSplit, int endSplit);
+    int applySplits(dcel_t *dcel, splitPair_t *splits, int splitsNum, int threadsNum);
+    splitPair_t *readSplits(FILE *file, int *splitsNum);
     int isOfHalfPlane(halfedge_t *HalfEdge, vertex_t *vertices, double targetX, double targetY);
+    int isInFace(dcel_t *dcel, int faceIdx, double targetX, double targetY);
+    int checkpointDcel(dcel_t *dcel);
+    int isCheckpoint(dcel_t *dcel, int checkpoint);
+    void undoLastSplit(dcel_t *dcel);
+    int rollbackDcel(dcel_t *dcel, int checkpoint);
+    void releaseCheckpoints(dcel_t *dcel);
     void freeList(dcel_t *dcel);
 
 #endif
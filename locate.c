@@ -0,0 +1,1134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+#include "list.h"
+#include "halfplane.h"
+#include "locate.h"
+#include "parallel.h"
+#include "stats.h"
+
+#define EPSILON 0.000001d
+#define RELATIVE_PAD 0.000001d
+#define MIN_SINE 0.000001d
+#define CELLS_PER_FACE 2
+#define MAX_CELLS (1 << 22)
+#define MATCHES 64
+#define CELLS_PER_TASK 64
+#define TOWERS_PER_TASK 4096
+#define MAX_WALK 1024
+#define HILBERT_BITS 16
+#define HILBERT_DIGITS (1 << HILBERT_BITS)
+#define HILBERT_SIDE (1u << HILBERT_BITS)
+#define EDGE_PLANES 3
+#define MAX_PIECES 64
+#define FRAME_SCALE 1.0
+#define ROUNDING 0.000000000001d
+
+/* A half-plane normalX * x + normalY * y <= offset, for clipping */
+typedef struct {
+    double normalX, normalY;
+    double offset;
+} clipPlane_t;
+
+/* Clamp a coordinate to a cell index in [0, cells) */
+static int cellOf(double coord, double min, double size, int cells) {
+
+    double cell = floor((coord - min) / size);
+
+    if (cell < 0) {
+        return 0;
+    }
+    if (cell >= cells) {
+        return cells - 1;
+    }
+    return (int) cell;
+}
+
+/* Compute bounding box of a face, returns 0 if the face is loose: it has an edge that
+   isOfHalfPlane handles with the EPSILON rule instead of its true half-plane, or a spike so
+   thin that rounding may stretch the face far past its vertices */
+int faceBox(dcel_t *dcel, int faceIdx, bbox_t *box) {
+
+    halfedge_t *halfEdges = dcel->halfEdges;
+    int start = dcel->faces[faceIdx].halfEdge, tmp = start, isTight = 1;
+
+    box->minX = box->maxX = dcel->vertices[halfEdges[start].startVertexIdx].x;
+    box->minY = box->maxY = dcel->vertices[halfEdges[start].startVertexIdx].y;
+    do {
+        vertex_t v = dcel->vertices[halfEdges[tmp].startVertexIdx], w = dcel->vertices[halfEdges[tmp].endVertexIdx];
+        vertex_t u = dcel->vertices[halfEdges[halfEdges[tmp].next].endVertexIdx];
+        double dx = w.x - v.x, dy = w.y - v.y, nextDx = u.x - w.x, nextDy = u.y - w.y;
+
+        box->minX = fmin(box->minX, v.x);
+        box->maxX = fmax(box->maxX, v.x);
+        box->minY = fmin(box->minY, v.y);
+        box->maxY = fmax(box->maxY, v.y);
+
+        if ((dx != 0 && fabs(dx) < EPSILON) || (dx == 0 && fabs(dy) < EPSILON)) {
+            isTight = 0;
+        }
+        if (dx * nextDx + dy * nextDy < 0 &&
+            fabs(dx * nextDy - dy * nextDx) < MIN_SINE * hypot(dx, dy) * hypot(nextDx, nextDy)) {
+            isTight = 0;
+        }
+        tmp = halfEdges[tmp].next;
+    } while (tmp != start);
+
+    return isTight;
+}
+
+/* Padding that takes a face's bounding box well past any rounding in isOfHalfPlane, for faces within
+   a given total bounding box */
+double boxPad(bbox_t *total) {
+
+    return EPSILON + RELATIVE_PAD * fmax(fmax(fabs(total->minX), fabs(total->maxX)),
+                                         fmax(fabs(total->minY), fabs(total->maxY)));
+}
+
+/* Add the half-plane of a rule, on the accepted side of the line through a vertex with a given normal,
+   moved out by slack */
+static void addClipPlane(clipPlane_t *plane, double normalX, double normalY, vertex_t start, double slack) {
+
+    double length = hypot(normalX, normalY);
+
+    plane->normalX = normalX / length;
+    plane->normalY = normalY / length;
+    plane->offset = plane->normalX * start.x + plane->normalY * start.y + slack;
+}
+
+/* Write the half-planes of the rules of isOfHalfPlane that apply to an edge, each moved out by slack, a
+   point passes the edge if it is in any of them. Returns how many there are, 0 if the edge passes every
+   point (a vertical edge shorter than EPSILON going up is both VERTICAL_UP and VERTICAL_DOWN) */
+static int edgeClipPlanes(vertex_t start, vertex_t end, double slack, clipPlane_t *planes) {
+
+    halfplane_t halfPlane;
+    int planesNum = 0;
+
+    edgeHalfPlane(start, end, &halfPlane);
+    if ((halfPlane.rules & VERTICAL_UP) && (halfPlane.rules & VERTICAL_DOWN)) {
+        return 0;
+    }
+    if (halfPlane.rules & (RISING | FALLING)) {
+        addClipPlane(&(planes[planesNum++]), start.y - end.y, end.x - start.x, start, slack);
+    }
+    if (halfPlane.rules & VERTICAL_UP) {
+        addClipPlane(&(planes[planesNum++]), -1, 0, start, slack);
+    }
+    if (halfPlane.rules & VERTICAL_DOWN) {
+        addClipPlane(&(planes[planesNum++]), 1, 0, start, slack);
+    }
+    return planesNum;
+}
+
+/* Clip a convex polygon to a half-plane, the result has at most one more vertex. Returns its size */
+static int clipPolygon(vertex_t *polygon, int verticesNum, clipPlane_t *plane, vertex_t *clipped) {
+
+    int clippedNum = 0;
+
+    for (int k = 0; k < verticesNum; k++) {
+        vertex_t a = polygon[k], b = polygon[(k + 1) % verticesNum];
+        double sideA = plane->normalX * a.x + plane->normalY * a.y - plane->offset;
+        double sideB = plane->normalX * b.x + plane->normalY * b.y - plane->offset;
+        if (sideA <= 0) {
+            clipped[clippedNum++] = a;
+        }
+        if ((sideA <= 0) != (sideB <= 0)) {
+            double t = sideA / (sideA - sideB);
+            clipped[clippedNum].x = a.x + t * (b.x - a.x);
+            clipped[clippedNum].y = a.y + t * (b.y - a.y);
+            clippedNum++;
+        }
+    }
+    return clippedNum;
+}
+
+/* Frame around a total bounding box, FRAME_SCALE times its size away from it, that loose faces are
+   bounded within */
+void faceFrame(bbox_t *total, double pad, bbox_t *frame) {
+
+    double margin = FRAME_SCALE * fmax(total->maxX - total->minX, total->maxY - total->minY) + pad;
+
+    frame->minX = total->minX - margin;
+    frame->minY = total->minY - margin;
+    frame->maxX = total->maxX + margin;
+    frame->maxY = total->maxY + margin;
+}
+
+/* Check if a point is in a frame, points with a NaN coordinate are not */
+int isInFrame(bbox_t *frame, double targetX, double targetY) {
+
+    return targetX >= frame->minX && targetX <= frame->maxX && targetY >= frame->minY && targetY <= frame->maxY;
+}
+
+/* Add a convex piece to a list of pieces */
+static void addPiece(facePieces_t *pieces, vertex_t *piece, int verticesNum) {
+
+    if (pieces->piecesNum == pieces->maxPieces) {
+        pieces->maxPieces = pieces->maxPieces ? 2 * pieces->maxPieces : MAX_PIECES;
+        pieces->pieceStart = realloc(pieces->pieceStart, (pieces->maxPieces + 1) * sizeof(int));
+        assert(pieces->pieceStart);
+        pieces->pieceStart[0] = 0;
+    }
+    while (pieces->verticesNum + verticesNum > pieces->maxVertices) {
+        pieces->maxVertices = pieces->maxVertices ? 2 * pieces->maxVertices : MAX_PIECES;
+        pieces->vertices = realloc(pieces->vertices, pieces->maxVertices * sizeof(vertex_t));
+        assert(pieces->vertices);
+    }
+    for (int k = 0; k < verticesNum; k++) {
+        pieces->vertices[pieces->verticesNum++] = piece[k];
+    }
+    pieces->piecesNum++;
+    pieces->pieceStart[pieces->piecesNum] = pieces->verticesNum;
+}
+
+/* Bound the points of a frame a loose face can accept, the box of its vertices in box grows to take them
+   in. An edge with more than one rule passes a point in any of their half-planes, which takes in a thin
+   wedge past its neighbours, so the accepted region is the union of one convex piece for every choice of
+   rule at each such edge. A piece is the frame clipped to the chosen half-planes, each moved out by far
+   more than the rounding in isOfHalfPlane within the frame. Edges past the first MAX_PIECES choices are
+   left out, which only makes the pieces larger. The pieces are added to pieces unless it is NULL.
+   Returns 0 if a piece reaches the frame: the face may then take in points outside the frame too */
+int boundFace(dcel_t *dcel, int faceIdx, bbox_t *frame, bbox_t *box, facePieces_t *pieces) {
+
+    halfedge_t *halfEdges = dcel->halfEdges;
+    int start = dcel->faces[faceIdx].halfEdge, tmp = start, edgesNum = dcel->faces[faceIdx].halfEdgesNum;
+    int planesNum = 0, baseNum = 4, piecesNum = 1, choicesNum = 0, isBounded = 1;
+    double slack = ROUNDING * fmax(fmax(fabs(frame->minX), fabs(frame->maxX)),
+                                   fmax(fabs(frame->minY), fabs(frame->maxY)));
+    clipPlane_t *planes = (clipPlane_t *) malloc(EDGE_PLANES * edgesNum * sizeof(clipPlane_t));
+    assert(planes);
+    int *choiceStart = (int *) malloc((edgesNum + 1) * sizeof(int));
+    assert(choiceStart);
+    vertex_t *base = (vertex_t *) malloc(3 * (edgesNum + 5) * sizeof(vertex_t));
+    assert(base);
+    vertex_t *piece = base + edgesNum + 5, *clipped = piece + edgesNum + 5;
+
+    base[0].x = base[3].x = frame->minX;
+    base[1].x = base[2].x = frame->maxX;
+    base[0].y = base[1].y = frame->minY;
+    base[2].y = base[3].y = frame->maxY;
+
+    /* Clip the frame to the edges with one rule, and keep the planes of the others to choose from */
+    do {
+        int edgePlanes = edgeClipPlanes(dcel->vertices[halfEdges[tmp].startVertexIdx],
+                                        dcel->vertices[halfEdges[tmp].endVertexIdx], slack, planes + planesNum);
+        if (edgePlanes == 1) {
+            baseNum = clipPolygon(base, baseNum, &(planes[planesNum]), clipped);
+            for (int k = 0; k < baseNum; k++) {
+                base[k] = clipped[k];
+            }
+        } else if (edgePlanes > 1 && piecesNum * edgePlanes <= MAX_PIECES) {
+            choiceStart[choicesNum++] = planesNum;
+            planesNum += edgePlanes;
+            piecesNum *= edgePlanes;
+        }
+        tmp = halfEdges[tmp].next;
+    } while (tmp != start);
+    choiceStart[choicesNum] = planesNum;
+
+    /* Clip the rest to each choice of rules, the digits of a piece's index choosing the rules */
+    for (int p = 0; baseNum > 0 && p < piecesNum; p++) {
+        int pieceNum = baseNum, digits = p;
+        for (int k = 0; k < baseNum; k++) {
+            piece[k] = base[k];
+        }
+        for (int c = 0; c < choicesNum && pieceNum > 0; c++) {
+            int rulesNum = choiceStart[c + 1] - choiceStart[c];
+            pieceNum = clipPolygon(piece, pieceNum, &(planes[choiceStart[c] + digits % rulesNum]), clipped);
+            digits /= rulesNum;
+            for (int k = 0; k < pieceNum; k++) {
+                piece[k] = clipped[k];
+            }
+        }
+        for (int k = 0; k < pieceNum; k++) {
+            if (piece[k].x <= frame->minX || piece[k].x >= frame->maxX ||
+                piece[k].y <= frame->minY || piece[k].y >= frame->maxY) {
+                isBounded = 0;
+            }
+            box->minX = fmin(box->minX, piece[k].x);
+            box->maxX = fmax(box->maxX, piece[k].x);
+            box->minY = fmin(box->minY, piece[k].y);
+            box->maxY = fmax(box->maxY, piece[k].y);
+        }
+        if (pieces != NULL && pieceNum > 0) {
+            addPiece(pieces, piece, pieceNum);
+        }
+    }
+
+    free(base);
+    free(choiceStart);
+    free(planes);
+
+    return isBounded;
+}
+
+/* List a face in a cell, counting it on the first pass and placing it on the second. A face whose
+   pieces overlap reaches the same cell more than once, lastFace lists it only the first time */
+static void addCellFace(faceGrid_t *grid, int cell, int faceIdx, int *fill, int *lastFace) {
+
+    if (lastFace[cell] == faceIdx) {
+        return;
+    }
+    lastFace[cell] = faceIdx;
+    if (fill == NULL) {
+        grid->cellStart[cell + 1]++;
+    } else {
+        grid->cellFaces[fill[cell]++] = faceIdx;
+    }
+}
+
+/* List a face in the cells a convex piece of it overlaps once padded, a row of cells at a time, so a long
+   thin piece across the grid takes only the cells along it */
+static void addPieceCells(faceGrid_t *grid, vertex_t *piece, int verticesNum, int faceIdx, int *fill,
+                          int *lastFace, vertex_t *band, vertex_t *clipped) {
+
+    double minY = piece[0].y, maxY = piece[0].y, pad = grid->pad;
+
+    for (int k = 1; k < verticesNum; k++) {
+        minY = fmin(minY, piece[k].y);
+        maxY = fmax(maxY, piece[k].y);
+    }
+    int minRow = cellOf(minY - pad, grid->minY, grid->cellHeight, grid->rows);
+    int maxRow = cellOf(maxY + pad, grid->minY, grid->cellHeight, grid->rows);
+    for (int row = minRow; row <= maxRow; row++) {
+        /* The first and last rows reach out to the frame */
+        clipPlane_t top = {0, 1, row < grid->rows - 1 ? grid->minY + (row + 1) * grid->cellHeight + pad : HUGE_VAL};
+        clipPlane_t bottom = {0, -1, row > 0 ? -(grid->minY + row * grid->cellHeight - pad) : HUGE_VAL};
+        int bandNum = clipPolygon(piece, verticesNum, &top, clipped);
+        double minX, maxX;
+        bandNum = clipPolygon(clipped, bandNum, &bottom, band);
+        if (bandNum == 0) {
+            continue;
+        }
+        minX = maxX = band[0].x;
+        for (int k = 1; k < bandNum; k++) {
+            minX = fmin(minX, band[k].x);
+            maxX = fmax(maxX, band[k].x);
+        }
+        int minColumn = cellOf(minX - pad, grid->minX, grid->cellWidth, grid->columns);
+        int maxColumn = cellOf(maxX + pad, grid->minX, grid->cellWidth, grid->columns);
+        for (int column = minColumn; column <= maxColumn; column++) {
+            addCellFace(grid, row * grid->columns + column, faceIdx, fill, lastFace);
+        }
+    }
+}
+
+/* Build the face grid of a dcel */
+faceGrid_t *buildFaceGrid(dcel_t *dcel) {
+
+    faceGrid_t *grid = (faceGrid_t *) malloc(sizeof(faceGrid_t));
+    assert(grid);
+    bbox_t total;
+    double width, height, cells, pad;
+
+    grid->facesNum = dcel->facesNum;
+    int cellsNum, *fill = NULL, *isTight = NULL, *lastFace = NULL, *firstPiece = NULL;
+    facePieces_t pieces = {0, 0, NULL, 0, 0, NULL};
+    vertex_t *band = NULL, *clipped = NULL;
+
+    grid->faceBoxes = (bbox_t *) malloc(dcel->facesNum * sizeof(bbox_t));
+    assert(grid->faceBoxes);
+    grid->looseFaces = (int *) malloc(dcel->facesNum * sizeof(int));
+    assert(grid->looseFaces);
+    isTight = grid->isTight = (int *) malloc(dcel->facesNum * sizeof(int));
+    assert(isTight);
+
+    for (int i = 0; i < dcel->facesNum; i++) {
+        isTight[i] = faceBox(dcel, i, &(grid->faceBoxes[i]));
+    }
+
+    /* Line coefficients of every face, each half-edge belongs to at most one face */
+    grid->planeStart = (int *) malloc((dcel->facesNum + 1) * sizeof(int));
+    assert(grid->planeStart);
+    grid->planes = (halfplane_t *) malloc(2 * dcel->edgesNum * sizeof(halfplane_t));
+    assert(grid->planes);
+    grid->planeFaces = (int *) malloc(2 * dcel->edgesNum * sizeof(int));
+    assert(grid->planeFaces);
+    grid->planeVertices = (vertex_t *) malloc(2 * dcel->edgesNum * sizeof(vertex_t));
+    assert(grid->planeVertices);
+    grid->planeStart[0] = 0;
+    for (int i = 0; i < dcel->facesNum; i++) {
+        int start = dcel->faces[i].halfEdge, tmp = start, k = grid->planeStart[i];
+        grid->planeStart[i + 1] = grid->planeStart[i] + faceHalfPlanes(dcel, i, grid->planes + grid->planeStart[i]);
+        do {
+            grid->planeFaces[k] = dcel->halfEdges[TWIN(tmp)].faceIdx;
+            grid->planeVertices[k++] = dcel->vertices[dcel->halfEdges[tmp].startVertexIdx];
+            tmp = dcel->halfEdges[tmp].next;
+        } while (tmp != start);
+    }
+
+    total = grid->faceBoxes[0];
+    for (int i = 1; i < dcel->facesNum; i++) {
+        total.minX = fmin(total.minX, grid->faceBoxes[i].minX);
+        total.maxX = fmax(total.maxX, grid->faceBoxes[i].maxX);
+        total.minY = fmin(total.minY, grid->faceBoxes[i].minY);
+        total.maxY = fmax(total.maxY, grid->faceBoxes[i].maxY);
+    }
+    pad = grid->pad = boxPad(&total);
+    faceFrame(&total, pad, &(grid->frame));
+
+    /* Loose faces take in the points of the frame their rules pass, those that may also take in points
+       outside it are tested against every watchtower outside it too */
+    grid->looseNum = 0;
+    firstPiece = (int *) malloc((dcel->facesNum + 1) * sizeof(int));
+    assert(firstPiece);
+    for (int i = 0; i < dcel->facesNum; i++) {
+        firstPiece[i] = pieces.piecesNum;
+        if (!isTight[i] && !boundFace(dcel, i, &(grid->frame), &(grid->faceBoxes[i]), &pieces)) {
+            grid->looseFaces[grid->looseNum++] = i;
+        }
+    }
+    firstPiece[dcel->facesNum] = pieces.piecesNum;
+    STATS_COUNT(unboundedFaces, grid->looseNum);
+
+    /* Pad the boxes well past any rounding in isOfHalfPlane. The grid covers the padded vertices, the
+       pieces of loose faces past it fall in the cells along its edges */
+    for (int i = 0; i < dcel->facesNum; i++) {
+        grid->faceBoxes[i].minX -= pad;
+        grid->faceBoxes[i].minY -= pad;
+        grid->faceBoxes[i].maxX += pad;
+        grid->faceBoxes[i].maxY += pad;
+    }
+    total.minX -= pad;
+    total.minY -= pad;
+    total.maxX += pad;
+    total.maxY += pad;
+
+    /* Choose roughly square cells, a couple per face */
+    width = total.maxX - total.minX;
+    height = total.maxY - total.minY;
+    cells = fmin((double) dcel->facesNum * CELLS_PER_FACE, MAX_CELLS);
+    grid->columns = (int) fmax(1, fmin(cells, round(sqrt(cells * width / height))));
+    grid->rows = (int) fmax(1, fmin(cells, round(cells / grid->columns)));
+    grid->minX = total.minX;
+    grid->minY = total.minY;
+    grid->cellWidth = width / grid->columns;
+    grid->cellHeight = height / grid->rows;
+    cellsNum = grid->columns * grid->rows;
+
+    /* Count faces per cell, then place them (counting sort keeps faces in increasing order). Tight faces
+       take the cells of their box, loose faces those of their pieces */
+    grid->cellStart = (int *) calloc(cellsNum + 1, sizeof(int));
+    assert(grid->cellStart);
+    lastFace = (int *) malloc(cellsNum * sizeof(int));
+    assert(lastFace);
+    band = (vertex_t *) malloc(2 * (dcel->edgesNum + 6) * sizeof(vertex_t));
+    assert(band);
+    clipped = band + dcel->edgesNum + 6;
+    for (int pass = 0; pass < 2; pass++) {
+        for (int cell = 0; cell < cellsNum; cell++) {
+            lastFace[cell] = -1;
+        }
+        for (int i = 0; i < dcel->facesNum; i++) {
+            bbox_t *box = &(grid->faceBoxes[i]);
+            if (!isTight[i]) {
+                for (int p = firstPiece[i]; p < firstPiece[i + 1]; p++) {
+                    addPieceCells(grid, pieces.vertices + pieces.pieceStart[p],
+                                  pieces.pieceStart[p + 1] - pieces.pieceStart[p], i, fill, lastFace, band, clipped);
+                }
+                continue;
+            }
+            int minColumn = cellOf(box->minX, grid->minX, grid->cellWidth, grid->columns);
+            int maxColumn = cellOf(box->maxX, grid->minX, grid->cellWidth, grid->columns);
+            int minRow = cellOf(box->minY, grid->minY, grid->cellHeight, grid->rows);
+            int maxRow = cellOf(box->maxY, grid->minY, grid->cellHeight, grid->rows);
+            for (int row = minRow; row <= maxRow; row++) {
+                for (int column = minColumn; column <= maxColumn; column++) {
+                    addCellFace(grid, row * grid->columns + column, i, fill, lastFace);
+                }
+            }
+        }
+        if (pass == 0) {
+            for (int cell = 0; cell < cellsNum; cell++) {
+                grid->cellStart[cell + 1] += grid->cellStart[cell];
+            }
+            grid->cellFaces = (int *) malloc((grid->cellStart[cellsNum] + 1) * sizeof(int));
+            assert(grid->cellFaces);
+            fill = (int *) malloc(cellsNum * sizeof(int));
+            assert(fill);
+            for (int cell = 0; cell < cellsNum; cell++) {
+                fill[cell] = grid->cellStart[cell];
+            }
+        }
+    }
+
+    free(band);
+    free(lastFace);
+    free(firstPiece);
+    free(pieces.vertices);
+    free(pieces.pieceStart);
+    free(fill);
+
+    return grid;
+}
+
+/* Record a (face, watchtower) pair */
+static void addMatch(matches_t *matches, int faceIdx, int tower) {
+
+    if (matches->matchesNum == matches->maxMatches) {
+        matches->maxMatches = matches->maxMatches ? 2 * matches->maxMatches : MATCHES;
+        matches->face = realloc(matches->face, matches->maxMatches * sizeof(int));
+        assert(matches->face);
+        matches->tower = realloc(matches->tower, matches->maxMatches * sizeof(int));
+        assert(matches->tower);
+    }
+    matches->face[matches->matchesNum] = faceIdx;
+    matches->tower[matches->matchesNum] = tower;
+    matches->matchesNum++;
+}
+
+/* Check if a point lies in a face using the line coefficients of the grid */
+static int isInGridFace(faceGrid_t *grid, int faceIdx, double targetX, double targetY) {
+
+    for (int k = grid->planeStart[faceIdx]; k < grid->planeStart[faceIdx + 1]; k++) {
+        if (!isOfHalfPlaneCoefficients(&(grid->planes[k]), targetX, targetY)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Find the grid cell of a point, or -1 if it is outside the frame. The cells along the edges of the grid
+   also take the points of the frame past them */
+static int gridCell(faceGrid_t *grid, double targetX, double targetY) {
+
+    if (isInFrame(&(grid->frame), targetX, targetY)) {
+        return cellOf(targetY, grid->minY, grid->cellHeight, grid->rows) * grid->columns + 
+               cellOf(targetX, grid->minX, grid->cellWidth, grid->columns);
+    }
+    return -1;
+}
+
+/* Find every face containing a watchtower, testing only the faces of its grid cell, or those without a
+   bound if it is outside the frame */
+void locateTower(faceGrid_t *grid, int tower, double targetX, double targetY, matches_t *matches) {
+
+    int cell = gridCell(grid, targetX, targetY);
+
+    if (cell >= 0) {
+        for (int k = grid->cellStart[cell]; k < grid->cellStart[cell + 1]; k++) {
+            int i = grid->cellFaces[k];
+            bbox_t *box = &(grid->faceBoxes[i]);
+            if (targetX >= box->minX && targetX <= box->maxX && targetY >= box->minY && targetY <= box->maxY &&
+                isInGridFace(grid, i, targetX, targetY)) {
+                addMatch(matches, i, tower);
+            }
+        }
+    }
+    if (isInFrame(&(grid->frame), targetX, targetY)) {
+        return;
+    }
+
+    for (int k = 0; k < grid->looseNum; k++) {
+        if (isInGridFace(grid, grid->looseFaces[k], targetX, targetY)) {
+            addMatch(matches, grid->looseFaces[k], tower);
+        }
+    }
+}
+
+/* Shared state of a parallel locateTowers or walkTowers run, matches, population sums and walk
+   lengths are kept per thread. Tasks past the first blockTasks each take one loose face without a bound,
+   against the watchtowers outside the frame */
+typedef struct {
+    faceGrid_t *grid;
+    double *towerX, *towerY;
+    int *population;
+    int towersNum;
+    int outsideNum;
+    int *outside;
+    double *outsideX, *outsideY;
+    int *cellStart, *order;
+    double *blockX, *blockY;
+    int blockTasks;
+    matches_t *matches;
+    long long **facePopulation;
+    unsigned char **isInside;
+    long long *walkSteps;
+} locateJob_t;
+
+/* Record a watchtower in a face */
+static void addTower(locateJob_t *job, int threadIdx, int faceIdx, int tower) {
+
+    addMatch(&(job->matches[threadIdx]), faceIdx, tower);
+    job->facePopulation[threadIdx][faceIdx] += job->population[tower];
+}
+
+/* Record the watchtowers of a classified block that lie in a face */
+static void addBlock(locateJob_t *job, int threadIdx, int faceIdx, int *order, int blockSize) {
+
+    unsigned char *isInside = job->isInside[threadIdx];
+
+    for (int j = 0; j < blockSize; j++) {
+        if (isInside[j]) {
+            addTower(job, threadIdx, faceIdx, order ? order[j] : j);
+        }
+    }
+}
+
+/* Classify the watchtowers outside the frame against one loose face without a bound */
+static void locateLoose(locateJob_t *job, int threadIdx, int looseIdx) {
+
+    faceGrid_t *grid = job->grid;
+    int i = grid->looseFaces[looseIdx];
+
+    classifyBatch(grid->planes + grid->planeStart[i], grid->planeStart[i + 1] - grid->planeStart[i],
+                  job->outsideX, job->outsideY, job->outsideNum, job->isInside[threadIdx]);
+    addBlock(job, threadIdx, i, job->outside, job->outsideNum);
+}
+
+/* Classify the watchtowers of a run of cells, or those outside the frame against one face without a
+   bound */
+static void locateTask(void *arg, int taskIdx, int threadIdx) {
+
+    locateJob_t *job = (locateJob_t *) arg;
+    faceGrid_t *grid = job->grid;
+    int cellsNum = grid->columns * grid->rows;
+
+    if (taskIdx >= job->blockTasks) {
+        locateLoose(job, threadIdx, taskIdx - job->blockTasks);
+        return;
+    }
+
+    for (int c = taskIdx * CELLS_PER_TASK; c < cellsNum && c < (taskIdx + 1) * CELLS_PER_TASK; c++) {
+        int first = job->cellStart[c], blockSize = job->cellStart[c + 1] - job->cellStart[c];
+        if (blockSize == 0) {
+            continue;
+        }
+        for (int k = grid->cellStart[c]; k < grid->cellStart[c + 1]; k++) {
+            int i = grid->cellFaces[k];
+            classifyBatch(grid->planes + grid->planeStart[i], grid->planeStart[i + 1] - grid->planeStart[i],
+                          job->blockX + first, job->blockY + first, blockSize, job->isInside[threadIdx]);
+            addBlock(job, threadIdx, i, job->order + first, blockSize);
+        }
+    }
+}
+
+/* Set up the per-thread state of a job, thread 0 adds straight into the caller's matches and sums */
+static void startJob(locateJob_t *job, faceGrid_t *grid, double *towerX, double *towerY, int *population, 
+                     int towersNum, int threadsNum, matches_t *matches, long long *facePopulation) {
+
+    job->grid = grid;
+    job->towerX = towerX;
+    job->towerY = towerY;
+    job->population = population;
+    job->towersNum = towersNum;
+    job->matches = (matches_t *) calloc(threadsNum, sizeof(matches_t));
+    assert(job->matches);
+    job->facePopulation = (long long **) malloc(threadsNum * sizeof(long long *));
+    assert(job->facePopulation);
+    job->isInside = (unsigned char **) malloc(threadsNum * sizeof(unsigned char *));
+    assert(job->isInside);
+    job->walkSteps = (long long *) calloc(threadsNum, sizeof(long long));
+    assert(job->walkSteps);
+    job->outside = (int *) malloc((towersNum + 1) * sizeof(int));
+    assert(job->outside);
+    job->outsideX = (double *) malloc((towersNum + 1) * sizeof(double));
+    assert(job->outsideX);
+    job->outsideY = (double *) malloc((towersNum + 1) * sizeof(double));
+    assert(job->outsideY);
+    job->outsideNum = 0;
+    for (int j = 0; j < towersNum; j++) {
+        if (!isInFrame(&(grid->frame), towerX[j], towerY[j])) {
+            job->outside[job->outsideNum] = j;
+            job->outsideX[job->outsideNum] = towerX[j];
+            job->outsideY[job->outsideNum++] = towerY[j];
+        }
+    }
+    job->matches[0] = *matches;
+    job->facePopulation[0] = facePopulation;
+    for (int t = 0; t < threadsNum; t++) {
+        if (t > 0) {
+            job->facePopulation[t] = (long long *) calloc(grid->facesNum, sizeof(long long));
+            assert(job->facePopulation[t]);
+        }
+        job->isInside[t] = (unsigned char *) malloc(towersNum + 1);
+        assert(job->isInside[t]);
+    }
+}
+
+/* Merge the other threads into thread 0 and free the per-thread state, returns the total walk length */
+static long long finishJob(locateJob_t *job, int threadsNum, matches_t *matches, long long *facePopulation) {
+
+    long long walkSteps = 0;
+
+    *matches = job->matches[0];
+    for (int t = 1; t < threadsNum; t++) {
+        for (int k = 0; k < job->matches[t].matchesNum; k++) {
+            addMatch(matches, job->matches[t].face[k], job->matches[t].tower[k]);
+        }
+        for (int i = 0; i < job->grid->facesNum; i++) {
+            facePopulation[i] += job->facePopulation[t][i];
+        }
+        freeMatches(&(job->matches[t]));
+        free(job->facePopulation[t]);
+    }
+    for (int t = 0; t < threadsNum; t++) {
+        walkSteps += job->walkSteps[t];
+        free(job->isInside[t]);
+    }
+
+    free(job->outsideY);
+    free(job->outsideX);
+    free(job->outside);
+    free(job->walkSteps);
+    free(job->isInside);
+    free(job->facePopulation);
+    free(job->matches);
+
+    return walkSteps;
+}
+
+/* Find every face containing each watchtower and add up the population served in each face.
+   Watchtowers are bucketed by grid cell and each cell's block of coordinates is classified against
+   the faces of the cell with classifyBatch. Runs of cells are spread over threadsNum threads, each
+   with its own matches and population sums, which are merged at the end so the result does not
+   depend on the number of threads */
+void locateTowers(faceGrid_t *grid, double *towerX, double *towerY, int *population, int towersNum, 
+                  int threadsNum, matches_t *matches, long long *facePopulation) {
+
+    int cellsNum = grid->columns * grid->rows;
+    locateJob_t job;
+    int *cell = (int *) malloc((towersNum + 1) * sizeof(int));
+    assert(cell);
+
+    if (threadsNum < 1) {
+        threadsNum = 1;
+    }
+
+    job.blockTasks = (cellsNum + CELLS_PER_TASK - 1) / CELLS_PER_TASK;
+    job.cellStart = (int *) calloc(cellsNum + 2, sizeof(int));
+    assert(job.cellStart);
+    job.order = (int *) malloc((towersNum + 1) * sizeof(int));
+    assert(job.order);
+    job.blockX = (double *) malloc((towersNum + 1) * sizeof(double));
+    assert(job.blockX);
+    job.blockY = (double *) malloc((towersNum + 1) * sizeof(double));
+    assert(job.blockY);
+
+    /* Bucket watchtowers by cell, keeping input order within a cell */
+    for (int j = 0; j < towersNum; j++) {
+        cell[j] = gridCell(grid, towerX[j], towerY[j]);
+        if (cell[j] >= 0) {
+            job.cellStart[cell[j] + 2]++;
+        }
+    }
+    for (int c = 0; c < cellsNum; c++) {
+        job.cellStart[c + 2] += job.cellStart[c + 1];
+    }
+    for (int j = 0; j < towersNum; j++) {
+        if (cell[j] >= 0) {
+            int k = job.cellStart[cell[j] + 1]++;
+            job.order[k] = j;
+            job.blockX[k] = towerX[j];
+            job.blockY[k] = towerY[j];
+        }
+    }
+
+    startJob(&job, grid, towerX, towerY, population, towersNum, threadsNum, matches, facePopulation);
+    parallelFor(job.blockTasks + grid->looseNum, threadsNum, locateTask, &job);
+    finishJob(&job, threadsNum, matches, facePopulation);
+
+    free(job.blockY);
+    free(job.blockX);
+    free(job.order);
+    free(job.cellStart);
+    free(cell);
+}
+
+/* Position of a point along a Hilbert curve over the grid, HILBERT_SIDE points a side */
+static unsigned int hilbertKey(faceGrid_t *grid, double targetX, double targetY) {
+
+    double scaledX = (targetX - grid->minX) / (grid->columns * grid->cellWidth) * (HILBERT_SIDE - 1);
+    double scaledY = (targetY - grid->minY) / (grid->rows * grid->cellHeight) * (HILBERT_SIDE - 1);
+    unsigned int x, y, key = 0;
+
+    /* Points off the grid (or NaN) go to its edges */
+    x = scaledX >= 0 ? (scaledX <= HILBERT_SIDE - 1 ? (unsigned int) scaledX : HILBERT_SIDE - 1) : 0;
+    y = scaledY >= 0 ? (scaledY <= HILBERT_SIDE - 1 ? (unsigned int) scaledY : HILBERT_SIDE - 1) : 0;
+
+    for (unsigned int side = HILBERT_SIDE / 2; side > 0; side /= 2) {
+        unsigned int isRight = (x & side) > 0, isUp = (y & side) > 0, tmp;
+        key += side * side * ((3 * isRight) ^ isUp);
+        if (!isUp) {
+            if (isRight) {
+                x = HILBERT_SIDE - 1 - x;
+                y = HILBERT_SIDE - 1 - y;
+            }
+            tmp = x;
+            x = y;
+            y = tmp;
+        }
+    }
+
+    return key;
+}
+
+/* Check if a point passes every half-plane of a tight face by more than the grid's padding, no other
+   tight face can then contain it */
+static int isDeepInFace(faceGrid_t *grid, int faceIdx, double targetX, double targetY) {
+
+    for (int k = grid->planeStart[faceIdx]; k < grid->planeStart[faceIdx + 1]; k++) {
+        halfplane_t *halfPlane = &(grid->planes[k]);
+        double yR = targetY - (halfPlane->gradient * targetX + halfPlane->intercept);
+        if (halfPlane->rules & (VERTICAL_UP | VERTICAL_DOWN)) {
+            if (fabs(targetX - halfPlane->xStart) <= grid->pad) {
+                return 0;
+            }
+        } else if (yR * yR <= grid->pad * grid->pad * (1 + halfPlane->gradient * halfPlane->gradient)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* How far a point is on the accepted side of a half-plane, negative if it is not of it */
+static double halfPlaneSide(halfplane_t *halfPlane, double targetX, double targetY) {
+
+    double yR = targetY - (halfPlane->gradient * targetX + halfPlane->intercept);
+
+    if (halfPlane->rules & RISING) {
+        return -yR;
+    }
+    if (halfPlane->rules & FALLING) {
+        return yR;
+    }
+    if (halfPlane->rules & VERTICAL_UP) {
+        return targetX - halfPlane->xStart;
+    }
+    return halfPlane->xStart - targetX;
+}
+
+/* Walk from a face towards a point along the segment from a source point in the face, leaving each face
+   through the edge the segment crosses (of collinear edges, the one whose ends are either side of the
+   segment). Without a source the first edge whose half-plane the point
+   is not of is taken. Returns the face reached that contains the point, or NO_FACE if the walk leaves
+   the polygon, takes more than MAX_WALK steps or stops moving forward along the segment, which only
+   rounding near an edge or vertex on the way can cause */
+static int walkToFace(faceGrid_t *grid, int faceIdx, int hasSource, double sourceX, double sourceY, 
+                      double targetX, double targetY, long long *walkSteps) {
+
+    double lastT = 0;
+
+    for (int step = 0; step < MAX_WALK; step++) {
+        int exit = -1, first = grid->planeStart[faceIdx], last = grid->planeStart[faceIdx + 1];
+        double exitT = INFINITY;
+        for (int k = first; k < last; k++) {
+            halfplane_t *halfPlane = &(grid->planes[k]);
+            vertex_t start = grid->planeVertices[k], end = grid->planeVertices[k + 1 < last ? k + 1 : first];
+            double sourceSide, targetSide, startSide, endSide, t;
+            if (isOfHalfPlaneCoefficients(halfPlane, targetX, targetY)) {
+                continue;
+            }
+            if (exit < 0) {
+                exit = k;
+            }
+            if (!hasSource) {
+                break;
+            }
+            sourceSide = halfPlaneSide(halfPlane, sourceX, sourceY);
+            targetSide = halfPlaneSide(halfPlane, targetX, targetY);
+            startSide = (targetX - sourceX) * (start.y - sourceY) - (targetY - sourceY) * (start.x - sourceX);
+            endSide = (targetX - sourceX) * (end.y - sourceY) - (targetY - sourceY) * (end.x - sourceX);
+            if (sourceSide >= 0 && sourceSide > targetSide && 
+                ((startSide <= 0 && endSide >= 0) || (startSide >= 0 && endSide <= 0))) {
+                t = sourceSide / (sourceSide - targetSide);
+                if (t < exitT) {
+                    exitT = t;
+                    exit = k;
+                }
+            }
+        }
+        if (exit < 0) {
+            return faceIdx;
+        }
+        if (hasSource && (exitT == INFINITY || exitT < lastT)) {
+            return NO_FACE;
+        }
+        lastT = exitT;
+        faceIdx = grid->planeFaces[exit];
+        (*walkSteps)++;
+        if (faceIdx == NO_FACE) {
+            return NO_FACE;
+        }
+    }
+    return NO_FACE;
+}
+
+/* Locate a run of watchtowers in curve order, each walking from the face of the last one found. A walk
+   that ends deep inside a tight face is the whole answer among tight faces, so only the loose faces of
+   the grid cell are tested then; otherwise all of the cell's faces are */
+static void walkTask(void *arg, int taskIdx, int threadIdx) {
+
+    locateJob_t *job = (locateJob_t *) arg;
+    faceGrid_t *grid = job->grid;
+    int faceIdx = NO_FACE, found, hasSource = 0, isDeep;
+    double sourceX = 0, sourceY = 0;
+
+    if (taskIdx >= job->blockTasks) {
+        locateLoose(job, threadIdx, taskIdx - job->blockTasks);
+        return;
+    }
+
+    for (int n = taskIdx * TOWERS_PER_TASK; n < job->towersNum && n < (taskIdx + 1) * TOWERS_PER_TASK; n++) {
+        int tower = job->order[n], cell;
+        double targetX = job->towerX[tower], targetY = job->towerY[tower];
+
+        /* Only faces without a bound can hold watchtowers outside the frame, and none those in empty cells */
+        cell = gridCell(grid, targetX, targetY);
+        if (cell < 0 || grid->cellStart[cell] == grid->cellStart[cell + 1]) {
+            continue;
+        }
+        if (faceIdx == NO_FACE) {
+            faceIdx = grid->cellFaces[grid->cellStart[cell]];
+        }
+        found = walkToFace(grid, faceIdx, hasSource, sourceX, sourceY, targetX, targetY, &(job->walkSteps[threadIdx]));
+        if (found != NO_FACE) {
+            faceIdx = found;
+            sourceX = targetX;
+            sourceY = targetY;
+            hasSource = 1;
+        }
+        isDeep = found != NO_FACE && grid->isTight[found] && isDeepInFace(grid, found, targetX, targetY);
+        if (isDeep) {
+            addTower(job, threadIdx, found, tower);
+        }
+        for (int k = grid->cellStart[cell]; k < grid->cellStart[cell + 1]; k++) {
+            int i = grid->cellFaces[k];
+            bbox_t *box = &(grid->faceBoxes[i]);
+            if ((!isDeep || !grid->isTight[i]) &&
+                targetX >= box->minX && targetX <= box->maxX && targetY >= box->minY && targetY <= box->maxY &&
+                isInGridFace(grid, i, targetX, targetY)) {
+                addTower(job, threadIdx, i, tower);
+            }
+        }
+    }
+}
+
+/* Same result as locateTowers, found by walking the dcel instead: watchtowers are sorted along a
+   Hilbert curve so that consecutive ones are close, and each walks across edges from the face of the
+   one before. Runs of the curve are spread over threadsNum threads. Returns the number of edges
+   crossed in all */
+long long walkTowers(faceGrid_t *grid, double *towerX, double *towerY, int *population, int towersNum, 
+                     int threadsNum, matches_t *matches, long long *facePopulation) {
+
+    locateJob_t job;
+    long long walkSteps;
+    unsigned int *keys = (unsigned int *) malloc((towersNum + 1) * sizeof(unsigned int));
+    assert(keys);
+    int *byLow = (int *) malloc((towersNum + 1) * sizeof(int));
+    assert(byLow);
+    int *count = (int *) malloc((HILBERT_DIGITS + 1) * sizeof(int));
+    assert(count);
+
+    if (threadsNum < 1) {
+        threadsNum = 1;
+    }
+
+    job.blockTasks = (towersNum + TOWERS_PER_TASK - 1) / TOWERS_PER_TASK;
+    job.order = (int *) malloc((towersNum + 1) * sizeof(int));
+    assert(job.order);
+
+    /* Sort by curve position with two counting sorts, low half then high half of the key */
+    for (int j = 0; j < towersNum; j++) {
+        keys[j] = hilbertKey(grid, towerX[j], towerY[j]);
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        int shift = pass * HILBERT_BITS, *from = pass ? byLow : NULL, *to = pass ? job.order : byLow;
+        for (int d = 0; d <= HILBERT_DIGITS; d++) {
+            count[d] = 0;
+        }
+        for (int n = 0; n < towersNum; n++) {
+            count[((keys[from ? from[n] : n] >> shift) & (HILBERT_DIGITS - 1)) + 1]++;
+        }
+        for (int d = 0; d < HILBERT_DIGITS; d++) {
+            count[d + 1] += count[d];
+        }
+        for (int n = 0; n < towersNum; n++) {
+            int j = from ? from[n] : n;
+            to[count[(keys[j] >> shift) & (HILBERT_DIGITS - 1)]++] = j;
+        }
+    }
+
+    startJob(&job, grid, towerX, towerY, population, towersNum, threadsNum, matches, facePopulation);
+    parallelFor(job.blockTasks + grid->looseNum, threadsNum, walkTask, &job);
+    walkSteps = finishJob(&job, threadsNum, matches, facePopulation);
+
+    free(job.order);
+    free(count);
+    free(byLow);
+    free(keys);
+
+    return walkSteps;
+}
+
+/* Group matches by face with counting sorts, first by watchtower and then by face, so watchtowers
+   are in input order within a face. faceTowers[faceStart[i]] to faceTowers[faceStart[i + 1] - 1]
+   are in face i */
+void groupMatches(matches_t *matches, int facesNum, int towersNum, int **faceStart, int **faceTowers) {
+
+    int matchesNum = matches->matchesNum;
+    int *start = (int *) calloc(facesNum + towersNum + 1, sizeof(int));
+    assert(start);
+    int *byTower = (int *) malloc((matchesNum + 1) * sizeof(int));
+    assert(byTower);
+    int *towers = (int *) malloc((matchesNum + 1) * sizeof(int));
+    assert(towers);
+
+    /* Order matches by watchtower */
+    for (int k = 0; k < matchesNum; k++) {
+        start[matches->tower[k] + 1]++;
+    }
+    for (int j = 0; j < towersNum; j++) {
+        start[j + 1] += start[j];
+    }
+    for (int k = 0; k < matchesNum; k++) {
+        byTower[start[matches->tower[k]]++] = k;
+    }
+
+    /* Then stably by face */
+    for (int i = 0; i <= facesNum; i++) {
+        start[i] = 0;
+    }
+    for (int k = 0; k < matchesNum; k++) {
+        start[matches->face[k] + 1]++;
+    }
+    for (int i = 0; i < facesNum; i++) {
+        start[i + 1] += start[i];
+    }
+    for (int n = 0; n < matchesNum; n++) {
+        int k = byTower[n];
+        towers[start[matches->face[k]]++] = matches->tower[k];
+    }
+    for (int i = facesNum; i > 0; i--) {
+        start[i] = start[i - 1];
+    }
+    start[0] = 0;
+
+    free(byTower);
+    *faceStart = realloc(start, (facesNum + 1) * sizeof(int));
+    assert(*faceStart);
+    *faceTowers = towers;
+}
+
+/* Free matches */
+void freeMatches(matches_t *matches) {
+
+    free(matches->face);
+    free(matches->tower);
+    matches->face = NULL;
+    matches->tower = NULL;
+    matches->matchesNum = matches->maxMatches = 0;
+}
+
+/* Free face grid */
+void freeFaceGrid(faceGrid_t *grid) {
+
+    free(grid->cellStart);
+    free(grid->cellFaces);
+    free(grid->looseFaces);
+    free(grid->isTight);
+    free(grid->planeStart);
+    free(grid->planes);
+    free(grid->planeFaces);
+    free(grid->planeVertices);
+    free(grid->faceBoxes);
+    free(grid);
+}
+
+/* Start an empty cache over the faces of a dcel */
+faceCache_t *newFaceCache(dcel_t *dcel) {
+
+    faceCache_t *cache = (faceCache_t *) malloc(sizeof(faceCache_t));
+    assert(cache);
+    bbox_t total;
+
+    total.minX = total.maxX = dcel->vertices[0].x;
+    total.minY = total.maxY = dcel->vertices[0].y;
+    for (int i = 1; i < dcel->verticesNum; i++) {
+        total.minX = fmin(total.minX, dcel->vertices[i].x);
+        total.maxX = fmax(total.maxX, dcel->vertices[i].x);
+        total.minY = fmin(total.minY, dcel->vertices[i].y);
+        total.maxY = fmax(total.maxY, dcel->vertices[i].y);
+    }
+
+    cache->dcel = dcel;
+    cache->pad = boxPad(&total);
+    faceFrame(&total, cache->pad, &(cache->frame));
+    cache->maxFaces = 0;
+    cache->faces = NULL;
+
+    return cache;
+}
+
+/* Get the cached box and half-planes of a face, working them out again if the face changed */
+cachedFace_t *cacheFace(faceCache_t *cache, int faceIdx) {
+
+    dcel_t *dcel = cache->dcel;
+    cachedFace_t *face = NULL;
+    int oldMax = cache->maxFaces;
+
+    if (faceIdx >= cache->maxFaces) {
+        while (cache->maxFaces <= faceIdx) {
+            cache->maxFaces = cache->maxFaces ? 2 * cache->maxFaces : dcel->facesNum;
+        }
+        cache->faces = realloc(cache->faces, cache->maxFaces * sizeof(cachedFace_t));
+        assert(cache->faces);
+        for (int i = oldMax; i < cache->maxFaces; i++) {
+            cache->faces[i].stamp = -1;
+            cache->faces[i].planesNum = cache->faces[i].maxPlanes = 0;
+            cache->faces[i].planes = NULL;
+        }
+    }
+
+    face = &(cache->faces[faceIdx]);
+    if (face->stamp == dcel->faces[faceIdx].stamp) {
+        return face;
+    }
+
+    face->stamp = dcel->faces[faceIdx].stamp;
+    face->isTight = faceBox(dcel, faceIdx, &(face->box));
+    face->isBounded = face->isTight || boundFace(dcel, faceIdx, &(cache->frame), &(face->box), NULL);
+    face->box.minX -= cache->pad;
+    face->box.minY -= cache->pad;
+    face->box.maxX += cache->pad;
+    face->box.maxY += cache->pad;
+    if (dcel->faces[faceIdx].halfEdgesNum > face->maxPlanes) {
+        face->maxPlanes = dcel->faces[faceIdx].halfEdgesNum;
+        face->planes = realloc(face->planes, face->maxPlanes * sizeof(halfplane_t));
+        assert(face->planes);
+    }
+    face->planesNum = faceHalfPlanes(dcel, faceIdx, face->planes);
+
+    return face;
+}
+
+/* Check if a point is in a face, rejecting points outside its padded box before testing the cached
+   half-planes. The box of a face without a bound only holds the points of the frame it takes in.
+   Gives the same answer as isInFace */
+int isInCachedFace(faceCache_t *cache, int faceIdx, double targetX, double targetY) {
+
+    cachedFace_t *face = cacheFace(cache, faceIdx);
+
+    if ((face->isBounded || isInFrame(&(cache->frame), targetX, targetY)) &&
+        (targetX < face->box.minX || targetX > face->box.maxX ||
+         targetY < face->box.minY || targetY > face->box.maxY)) {
+        return 0;
+    }
+    for (int k = 0; k < face->planesNum; k++) {
+        if (!isOfHalfPlaneCoefficients(&(face->planes[k]), targetX, targetY)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Free a face cache */
+void freeFaceCache(faceCache_t *cache) {
+
+    for (int i = 0; i < cache->maxFaces; i++) {
+        free(cache->faces[i].planes);
+    }
+    free(cache->faces);
+    free(cache);
+}
@@ -0,0 +1,100 @@
+#ifndef LOCATE_H
+#define LOCATE_H
+
+    #include "list.h"
+    #include "halfplane.h"
+
+    typedef struct {
+        double minX, minY;
+        double maxX, maxY;
+    } bbox_t;
+
+    /* Uniform grid over the vertices of a dcel, every cell lists the faces whose (padded) bounding box
+       overlaps it, and the cells along its edges take in the rest of the frame. Loose faces have an edge
+       shorter than EPSILON in x, which isOfHalfPlane does not treat as a plain half-plane, or a thin
+       spike; they are listed in the cells of the points of the frame their half-planes can pass
+       (boundFace), and their box takes those points in. The few that may pass points outside the frame
+       too are listed in looseFaces and tested against every watchtower outside it.
+       The half-planes of face i are planes[planeStart[i]] to planes[planeStart[i + 1] - 1], and
+       planeFaces holds the face on the other side of each, NO_FACE on the boundary, and planeVertices the
+       vertex its edge starts at */
+    typedef struct {
+        int facesNum;
+        int columns, rows;
+        double minX, minY;
+        double cellWidth, cellHeight;
+        double pad;
+        int *cellStart;
+        int *cellFaces;
+        int looseNum;
+        int *looseFaces;
+        int *isTight;
+        bbox_t frame;
+        int *planeStart;
+        halfplane_t *planes;
+        int *planeFaces;
+        vertex_t *planeVertices;
+        bbox_t *faceBoxes;
+    } faceGrid_t;
+
+    /* Convex pieces of the points a loose face accepts, piece p has vertices[pieceStart[p]] to
+       vertices[pieceStart[p + 1] - 1] */
+    typedef struct {
+        int piecesNum, maxPieces;
+        int *pieceStart;
+        int verticesNum, maxVertices;
+        vertex_t *vertices;
+    } facePieces_t;
+
+    /* Bounding box, looseness and half-planes of a face, worked out when the face had the given stamp.
+       The box of a loose face takes in the points of the frame it can pass (boundFace), and isBounded
+       is 0 if it may pass points outside the frame too */
+    typedef struct {
+        int stamp;
+        int isTight;
+        int isBounded;
+        bbox_t box;
+        int planesNum;
+        int maxPlanes;
+        halfplane_t *planes;
+    } cachedFace_t;
+
+    /* Faces of a dcel worked out on demand. Splits stamp the faces they change, so an entry is only worked
+       out again once its face has changed and the faces a split leaves alone keep theirs. The pad and
+       frame are those of boxPad and faceFrame over every vertex, which splits never move past */
+    typedef struct {
+        dcel_t *dcel;
+        double pad;
+        bbox_t frame;
+        int maxFaces;
+        cachedFace_t *faces;
+    } faceCache_t;
+
+    /* (face, watchtower) pairs found by the locator */
+    typedef struct {
+        int matchesNum;
+        int maxMatches;
+        int *face;
+        int *tower;
+    } matches_t;
+
+    int faceBox(dcel_t *dcel, int faceIdx, bbox_t *box);
+    double boxPad(bbox_t *total);
+    void faceFrame(bbox_t *total, double pad, bbox_t *frame);
+    int isInFrame(bbox_t *frame, double targetX, double targetY);
+    int boundFace(dcel_t *dcel, int faceIdx, bbox_t *frame, bbox_t *box, facePieces_t *pieces);
+    faceGrid_t *buildFaceGrid(dcel_t *dcel);
+    void locateTower(faceGrid_t *grid, int tower, double targetX, double targetY, matches_t *matches);
+    void locateTowers(faceGrid_t *grid, double *towerX, double *towerY, int *population, int towersNum, 
+                      int threadsNum, matches_t *matches, long long *facePopulation);
+    long long walkTowers(faceGrid_t *grid, double *towerX, double *towerY, int *population, int towersNum, 
+                         int threadsNum, matches_t *matches, long long *facePopulation);
+    void groupMatches(matches_t *matches, int facesNum, int towersNum, int **faceStart, int **faceTowers);
+    void freeMatches(matches_t *matches);
+    void freeFaceGrid(faceGrid_t *grid);
+    faceCache_t *newFaceCache(dcel_t *dcel);
+    cachedFace_t *cacheFace(faceCache_t *cache, int faceIdx);
+    int isInCachedFace(faceCache_t *cache, int faceIdx, double targetX, double targetY);
+    void freeFaceCache(faceCache_t *cache);
+
+#endif
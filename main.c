@@ -2,40 +2,192 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "watchtower.h"
 #include "list.h"
+#include "locate.h"
+#include "online.h"
+#include "snapshot.h"
+#include "splitlog.h"
+#include "writer.h"
+#include "stats.h"
+#include "towertree.h"
+#include "batch.h"
 
-void writeWatchTower(FILE *file, dcel_t *dcel, watchtower_t **watchTower, int watchTowerNum);
+#define USAGE "Usage: %s [-t threads] [-w] [-l snapshot] [-s snapshot] [-b splitlog] [-B splitlog] [-S stats] " \
+              "watchtowers [polygon] output < splits\n" \
+              "       %s -i [-t threads] [-l snapshot] [-s snapshot] [-b splitlog] [-S stats] watchtowers [polygon] " \
+              "< commands\n" \
+              "       %s -q queries [-t threads] watchtowers output\n" \
+              "       %s -m manifest [-t threads] [-w]\n" \
+              "The polygon is left out when a snapshot is loaded with -l, splits are read from -b instead of stdin\n" \
+              "-S writes counters and timings as JSON, and needs a build with -DSTATS (make voronoi1-stats)\n" \
+              "-m runs every \"watchtowers polygon splits output\" line of a manifest, spread over the threads\n"
+
+/* Watchtowers read on a thread of their own while the dcel is built and split */
+typedef struct {
+    FILE *file;
+    int threadsNum;
+    pthread_t thread;
+    towertable_t *towers;
+} towerLoader_t;
+
+void startTowers(towerLoader_t *loader);
+towertable_t *finishTowers(towerLoader_t *loader);
+void writeSnapshot(dcel_t *dcel, char *filename);
+void performQueries(towertable_t *towers, char *queryName, char *outputName, int threadsNum);
+int performBatch(char *manifestName, int threadsNum, int isWalk);
+void performSplits(dcel_t *dcel, char *logName, char *saveLogName, int threadsNum);
+void writeStatsFile(dcel_t *dcel, char *filename);
 
 int main(int argc, char *argv[]) {
         
-    int watchTowerNum = 0;
-    char *filename = NULL;    
-    watchtower_t **watchTower = NULL;
+    int threadsNum = 1, isWalk = 0, isOnline = 0, arguments, option;
+    char *filename = NULL, *loadName = NULL, *saveName = NULL, *logName = NULL, *saveLogName = NULL,
+         *statsName = NULL, *queryName = NULL, *manifestName = NULL;
+    towertable_t *towers = NULL;
+    towerLoader_t loader;
     dcel_t *dcel = NULL;
+    FILE *file2 = NULL;
+
+    /* Read options */
+    while ((option = getopt(argc, argv, "t:wil:s:b:B:S:q:m:")) != -1) {
+        switch (option) {
+            case 't':
+                threadsNum = atoi(optarg);
+                break;
+            case 'w':
+                isWalk = 1;
+                break;
+            case 'i':
+                isOnline = 1;
+                break;
+            case 'l':
+                loadName = optarg;
+                break;
+            case 's':
+                saveName = optarg;
+                break;
+            case 'b':
+                logName = optarg;
+                break;
+            case 'B':
+                saveLogName = optarg;
+                break;
+            case 'S':
+                statsName = optarg;
+                break;
+            case 'q':
+                queryName = optarg;
+                break;
+            case 'm':
+                manifestName = optarg;
+                break;
+            default:
+                fprintf(stderr, USAGE, argv[0], argv[0], argv[0], argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    arguments = manifestName != NULL ? 0 : queryName != NULL ? 2 : 1 + (loadName == NULL) + !isOnline;
+    if (argc - optind < arguments || threadsNum < 1 || (isOnline && saveLogName != NULL) ||
+        (queryName != NULL && (isOnline || isWalk || loadName != NULL || saveName != NULL || logName != NULL ||
+                               saveLogName != NULL || statsName != NULL)) ||
+        (manifestName != NULL && (isOnline || queryName != NULL || loadName != NULL || saveName != NULL ||
+                                  logName != NULL || saveLogName != NULL || statsName != NULL))) {
+        fprintf(stderr, USAGE, argv[0], argv[0], argv[0], argv[0]);
+        exit(EXIT_FAILURE);
+    }
+#ifndef STATS
+    if (statsName != NULL) {
+        fprintf(stderr, "%s was built without -DSTATS, build voronoi1-stats for -S\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+#endif
     
-    /* Read watchtowers information */
-    filename = argv[1];
+    /* Run the jobs of a manifest, each with its own files */
+    if (manifestName != NULL) {
+        return performBatch(manifestName, threadsNum, isWalk) == 0 ? 0 : EXIT_FAILURE;
+    }
+
+    /* Answer queries about the watchtowers alone, there is no dcel */
+    if (queryName != NULL) {
+        FILE *file1 = fopen(argv[optind], "r");
+        assert(file1);
+        towers = readWatchtower(file1, threadsNum);
+        performQueries(towers, queryName, argv[optind + 1], threadsNum);
+        freeWatchTower(towers);
+        fclose(file1);
+        return 0;
+    }
+
+    /* Start reading watchtowers information, which nothing needs until they are located */
+    filename = argv[optind];
     FILE *file1 = fopen(filename, "r");
     assert(file1);
-    watchTower = readWatchtower(file1, watchTower, &watchTowerNum);
+    loader.file = file1;
+    loader.threadsNum = threadsNum;
+    startTowers(&loader);
 
-    /* Constructing initial dcel */
-    filename = argv[2];
-    FILE *file2 = fopen(filename, "r");
-    assert(file2);
-    dcel = constructInitialDcel(file2);
+    /* Load the dcel from a snapshot, or construct the initial dcel from the polygon */
+    STATS_START(PHASE_BUILD_DCEL);
+    if (loadName != NULL) {
+        file2 = fopen(loadName, "rb");
+        assert(file2);
+        dcel = loadDcel(file2);
+        if (dcel == NULL) {
+            fprintf(stderr, "%s is not a dcel snapshot of version %d\n", loadName, SNAPSHOT_VERSION);
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        filename = argv[optind + 1];
+        file2 = fopen(filename, "r");
+        assert(file2);
+        dcel = constructInitialDcel(file2);
+    }
+    STATS_STOP(PHASE_BUILD_DCEL);
+
+    /* Answer commands from stdin as they come, after any splits from a split log */
+    if (isOnline) {
+        if (logName != NULL) {
+            performSplits(dcel, logName, NULL, threadsNum);
+        }
+        towers = finishTowers(&loader);
+        STATS_START(PHASE_ONLINE);
+        online_t *online = startOnline(dcel, towers, threadsNum);
+        runOnline(online, stdin, stdout);
+        freeOnline(online);
+        STATS_STOP(PHASE_ONLINE);
+        if (saveName != NULL) {
+            writeSnapshot(dcel, saveName);
+        }
+        if (statsName != NULL) {
+            writeStatsFile(dcel, statsName);
+        }
+        freeWatchTower(towers);
+        freeList(dcel);
+        fclose(file1);
+        fclose(file2);
+        return 0;
+    }
 
     /* Perform split */
-    split(dcel);
+    performSplits(dcel, logName, saveLogName, threadsNum);
+    if (saveName != NULL) {
+        writeSnapshot(dcel, saveName);
+    }
+    towers = finishTowers(&loader);
     
     /* Write to output file and print content */ 
-    filename = argv[3];
+    filename = argv[optind + arguments - 1];
     FILE *file3 = fopen(filename, "w");
     assert(file3);
-    writeWatchTower(file3, dcel, watchTower, watchTowerNum);
+    writeWatchTower(file3, dcel, towers, threadsNum, isWalk);
+    if (statsName != NULL) {
+        writeStatsFile(dcel, statsName);
+    }
     
-    freeWatchTower(watchTower, watchTowerNum);
+    freeWatchTower(towers);
     freeList(dcel);
     fclose(file1);
     fclose(file2);
@@ -44,46 +196,150 @@ int main(int argc, char *argv[]) {
     return 0;
 }
 
-/* Check if watchtower is in face and write the output to output file */
-void writeWatchTower(FILE *file, dcel_t *dcel, watchtower_t **watchTower, int watchTowerNum) {
-
-    size_t faces = dcel->facesNum;
-    int isInFace, first;
-    int facePopulation[faces];
-    halfedge_t *tmp = NULL, *start = NULL;
-
-    memset(facePopulation, 0, faces*sizeof(int));
-       
-    /* Traverse all half-edges in a face to check whether watchtower lies in that face */
-    for (int i = 0; i < faces; i++) {
-        fprintf(file, "%d\n", i);       
-        for (int j = 0; j < watchTowerNum; j++) {            
-            isInFace = 1;
-            first = 1;
-            tmp = dcel->faces[i].halfEdge;
-            start = dcel->faces[i].halfEdge;
-            while (tmp != start || first) {
-                first = 0;
-                /* Check watchtower coordinate against each half-edge */
-                if (!isOfHalfPlane(tmp, dcel->vertices, watchTower[j]->x, watchTower[j]->y)) {
-                    isInFace = 0;
-                    break;
-                }
-                tmp = tmp->next;
-            }
-            if(isInFace) {
-                fprintf(file, "Watchtower ID: %s, Postcode: %s, Population Served: %d, "
-                              "Watchtower Point of Contact Name: %s, x: %lf, y: %lf\n", watchTower[j]->ID, 
-                               watchTower[j]->postcode, watchTower[j]->populationServed, watchTower[j]->contact, 
-                               watchTower[j]->x, watchTower[j]->y);
-                facePopulation[i] += (watchTower[j]->populationServed);
-            }
+/* Read the watchtowers, timed as a phase of their own */
+void *loadTowers(void *arg) {
+
+    towerLoader_t *loader = (towerLoader_t *) arg;
+
+    STATS_START(PHASE_READ_TOWERS);
+    loader->towers = readWatchtower(loader->file, loader->threadsNum);
+    STATS_STOP(PHASE_READ_TOWERS);
+    return NULL;
+}
+
+/* Read the watchtowers on a thread of their own if there is more than one thread, otherwise right away */
+void startTowers(towerLoader_t *loader) {
+
+    if (loader->threadsNum <= 1) {
+        loadTowers(loader);
+        return;
+    }
+    if (pthread_create(&(loader->thread), NULL, loadTowers, loader) != 0) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Wait for the watchtowers to be read */
+towertable_t *finishTowers(towerLoader_t *loader) {
+
+    if (loader->threadsNum > 1) {
+        STATS_START(PHASE_WAIT_TOWERS);
+        pthread_join(loader->thread, NULL);
+        STATS_STOP(PHASE_WAIT_TOWERS);
+    }
+    return loader->towers;
+}
+
+/* Apply splits from a binary split log if one is given, otherwise from text on stdin, and save the splits
+   as a split log if asked */
+void performSplits(dcel_t *dcel, char *logName, char *saveLogName, int threadsNum) {
+
+    FILE *file = NULL;
+    splitLog_t *log = NULL;
+    splitPair_t *splits = NULL;
+    int splitsNum;
+
+    STATS_START(PHASE_READ_SPLITS);
+    if (logName != NULL) {
+        file = fopen(logName, "rb");
+        assert(file);
+        log = openSplitLog(file);
+        if (log == NULL) {
+            fprintf(stderr, "%s is not a split log of version %d\n", logName, SPLITLOG_VERSION);
+            exit(EXIT_FAILURE);
         }
+        splits = log->splits;
+        splitsNum = log->splitsNum;
+    } else {
+        splits = readSplits(stdin, &splitsNum);
+    }
+    STATS_STOP(PHASE_READ_SPLITS);
+
+    STATS_START(PHASE_APPLY_SPLITS);
+    applySplits(dcel, splits, splitsNum, threadsNum);
+    STATS_STOP(PHASE_APPLY_SPLITS);
+
+    if (saveLogName != NULL) {
+        FILE *saveFile = fopen(saveLogName, "wb");
+        assert(saveFile);
+        if (!saveSplitLog(splits, splitsNum, saveFile)) {
+            fprintf(stderr, "Could not write split log %s\n", saveLogName);
+            exit(EXIT_FAILURE);
+        }
+        fclose(saveFile);
+    }
+
+    if (log != NULL) {
+        closeSplitLog(log);
+        fclose(file);
+    } else {
+        free(splits);
+    }
+}
+
+/* Index the watchtowers in a k-d tree and answer the queries of a query file into an output file */
+void performQueries(towertable_t *towers, char *queryName, char *outputName, int threadsNum) {
+
+    FILE *queryFile = fopen(queryName, "r"), *output = NULL;
+    assert(queryFile);
+    towerTree_t *tree = buildTowerTree(towers);
+    towerQuery_t *queries = NULL;
+    int queriesNum;
+
+    queries = readQueries(queryFile, &queriesNum);
+    output = fopen(outputName, "w");
+    assert(output);
+    runQueries(tree, towers, queries, queriesNum, output, threadsNum);
+
+    free(queries);
+    freeTowerTree(tree);
+    fclose(output);
+    fclose(queryFile);
+}
+
+/* Run the jobs of a manifest file over the threads, returns the number of jobs that failed */
+int performBatch(char *manifestName, int threadsNum, int isWalk) {
+
+    FILE *file = fopen(manifestName, "r");
+    assert(file);
+    manifest_t *manifest = readManifest(file, manifestName);
+    int failedNum;
+
+    if (manifest == NULL) {
+        exit(EXIT_FAILURE);
     }
-            
-    /* Write the population served in each face to the file */
-    for (int i = 0; i < faces; i++) {
-        fprintf(file, "Face %d population served: %d\n", i, facePopulation[i]);
+    failedNum = runBatch(manifest, threadsNum, isWalk);
+    if (failedNum > 0) {
+        fprintf(stderr, "%d of %d jobs failed\n", failedNum, manifest->jobsNum);
     }
+
+    freeManifest(manifest);
+    fclose(file);
+    return failedNum;
 }
 
+/* Save the dcel to a snapshot file */
+void writeSnapshot(dcel_t *dcel, char *filename) {
+
+    FILE *file = fopen(filename, "wb");
+    assert(file);
+
+    if (!saveDcel(dcel, file)) {
+        fprintf(stderr, "Could not write snapshot %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    fclose(file);
+}
+
+/* Write the counters and timings of the run to a file, only reached in a build with -DSTATS */
+void writeStatsFile(dcel_t *dcel, char *filename) {
+
+#ifdef STATS
+    FILE *file = fopen(filename, "w");
+    assert(file);
+
+    writeStats(file, dcel);
+    fclose(file);
+#endif
+}
@@ -0,0 +1,394 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+#include "list.h"
+#include "halfplane.h"
+#include "locate.h"
+#include "watchtower.h"
+#include "online.h"
+
+#define TOWERS 16
+#define TOWERS_PER_CELL 4
+#define MAX_TOWER_CELLS (1 << 22)
+#define COMMAND_SIZE 16
+#define LINE_SIZE 256
+
+/* Make sure the face lists have space for every face of the dcel */
+static void growFaces(online_t *online) {
+
+    int oldMax = online->maxFaces;
+
+    if (online->maxFaces >= online->dcel->facesNum) {
+        return;
+    }
+    while (online->maxFaces < online->dcel->facesNum) {
+        online->maxFaces = online->maxFaces ? 2 * online->maxFaces : 1;
+    }
+    online->faces = realloc(online->faces, online->maxFaces * sizeof(faceTowers_t));
+    assert(online->faces);
+    memset(online->faces + oldMax, 0, (online->maxFaces - oldMax) * sizeof(faceTowers_t));
+}
+
+/* Add a watchtower to the end of a face's list */
+static void addFaceTower(online_t *online, int faceIdx, int tower) {
+
+    faceTowers_t *face = &(online->faces[faceIdx]);
+
+    if (face->towersNum == face->maxTowers) {
+        face->maxTowers = face->maxTowers ? 2 * face->maxTowers : TOWERS;
+        face->towers = realloc(face->towers, face->maxTowers * sizeof(int));
+        assert(face->towers);
+    }
+    face->towers[face->towersNum++] = tower;
+    face->population += online->towers->populationServed[tower];
+}
+
+/* Clamp a coordinate to a cell index in [0, cells) */
+static int towerCell(double coord, double min, double size, int cells) {
+
+    double cell = floor((coord - min) / size);
+
+    if (cell < 0) {
+        return 0;
+    }
+    if (cell >= cells) {
+        return cells - 1;
+    }
+    return (int) cell;
+}
+
+/* Bucket the watchtowers into a grid of about TOWERS_PER_CELL each, keeping input order in a cell */
+static void buildTowerGrid(online_t *online) {
+
+    towertable_t *towers = online->towers;
+    bbox_t *frame = &(online->cache->frame);
+    int towersNum = towers->towersNum, cellsNum, griddedNum = 0, *fill = NULL, *cell = NULL;
+    double maxX = 0, maxY = 0, cells;
+
+    online->minX = online->minY = 0;
+    for (int j = 0; j < towersNum; j++) {
+        if (!isInFrame(frame, towers->x[j], towers->y[j])) {
+            continue;
+        }
+        if (griddedNum++ == 0) {
+            online->minX = maxX = towers->x[j];
+            online->minY = maxY = towers->y[j];
+        }
+        online->minX = fmin(online->minX, towers->x[j]);
+        online->minY = fmin(online->minY, towers->y[j]);
+        maxX = fmax(maxX, towers->x[j]);
+        maxY = fmax(maxY, towers->y[j]);
+    }
+
+    /* Roughly square cells, the box is widened a little so that a flat set of towers still has an area */
+    maxX += online->pad;
+    maxY += online->pad;
+    cells = fmax(1, fmin((double) griddedNum / TOWERS_PER_CELL, MAX_TOWER_CELLS));
+    online->columns = (int) fmax(1, fmin(cells, round(sqrt(cells * (maxX - online->minX) / (maxY - online->minY)))));
+    online->rows = (int) fmax(1, fmin(cells, round(cells / online->columns)));
+    online->cellWidth = (maxX - online->minX) / online->columns;
+    online->cellHeight = (maxY - online->minY) / online->rows;
+    cellsNum = online->columns * online->rows;
+
+    cell = (int *) malloc((towersNum + 1) * sizeof(int));
+    assert(cell);
+    online->cellStart = (int *) calloc(cellsNum + 1, sizeof(int));
+    assert(online->cellStart);
+    online->cellTowers = (int *) malloc((griddedNum + 1) * sizeof(int));
+    assert(online->cellTowers);
+    online->strays = (int *) malloc((towersNum - griddedNum + 1) * sizeof(int));
+    assert(online->strays);
+    fill = (int *) malloc(cellsNum * sizeof(int));
+    assert(fill);
+
+    online->straysNum = 0;
+    for (int j = 0; j < towersNum; j++) {
+        if (!isInFrame(frame, towers->x[j], towers->y[j])) {
+            cell[j] = -1;
+            online->strays[online->straysNum++] = j;
+            continue;
+        }
+        cell[j] = towerCell(towers->y[j], online->minY, online->cellHeight, online->rows) * online->columns +
+                  towerCell(towers->x[j], online->minX, online->cellWidth, online->columns);
+        online->cellStart[cell[j] + 1]++;
+    }
+    for (int c = 0; c < cellsNum; c++) {
+        online->cellStart[c + 1] += online->cellStart[c];
+        fill[c] = online->cellStart[c];
+    }
+    for (int j = 0; j < towersNum; j++) {
+        if (cell[j] >= 0) {
+            online->cellTowers[fill[cell[j]]++] = j;
+        }
+    }
+
+    free(fill);
+    free(cell);
+}
+
+/* Locate every watchtower in the faces the dcel has now and start the face lists from that */
+online_t *startOnline(dcel_t *dcel, towertable_t *towers, int threadsNum) {
+
+    online_t *online = (online_t *) calloc(1, sizeof(online_t));
+    assert(online);
+    int *faceStart = NULL, *faceTowers = NULL;
+    long long *facePopulation = NULL;
+    matches_t matches = {0, 0, NULL, NULL};
+    faceGrid_t *grid = buildFaceGrid(dcel);
+
+    online->dcel = dcel;
+    online->towers = towers;
+    online->pad = grid->pad;
+    online->cache = newFaceCache(dcel);
+    growFaces(online);
+    buildTowerGrid(online);
+    online->candidates = (int *) malloc((towers->towersNum + 1) * sizeof(int));
+    assert(online->candidates);
+    online->scratchX = (double *) malloc((towers->towersNum + 1) * sizeof(double));
+    assert(online->scratchX);
+    online->scratchY = (double *) malloc((towers->towersNum + 1) * sizeof(double));
+    assert(online->scratchY);
+    online->isInside = (unsigned char *) malloc(towers->towersNum + 1);
+    assert(online->isInside);
+
+    facePopulation = (long long *) calloc(dcel->facesNum, sizeof(long long));
+    assert(facePopulation);
+    locateTowers(grid, towers->x, towers->y, towers->populationServed, towers->towersNum, threadsNum,
+                 &matches, facePopulation);
+    groupMatches(&matches, dcel->facesNum, towers->towersNum, &faceStart, &faceTowers);
+    for (int i = 0; i < dcel->facesNum; i++) {
+        for (int k = faceStart[i]; k < faceStart[i + 1]; k++) {
+            addFaceTower(online, i, faceTowers[k]);
+        }
+    }
+
+    free(facePopulation);
+    free(faceTowers);
+    free(faceStart);
+    freeMatches(&matches);
+    freeFaceGrid(grid);
+
+    return online;
+}
+
+/* Compare watchtower indices for qsort */
+static int compareTowers(const void *first, const void *second) {
+
+    return *(const int *) first - *(const int *) second;
+}
+
+/* Gather the watchtowers that may lie in a face, in input order: those in its padded bounding box, which
+   for a loose face takes in the points of the frame it can pass, and the strays if the face has no
+   bound and may take in points outside the frame */
+static void gatherCandidates(online_t *online, int faceIdx) {
+
+    towertable_t *towers = online->towers;
+    cachedFace_t *face = cacheFace(online->cache, faceIdx);
+    bbox_t box = face->box;
+
+    online->candidatesNum = 0;
+
+    int minColumn = towerCell(box.minX, online->minX, online->cellWidth, online->columns);
+    int maxColumn = towerCell(box.maxX, online->minX, online->cellWidth, online->columns);
+    int minRow = towerCell(box.minY, online->minY, online->cellHeight, online->rows);
+    int maxRow = towerCell(box.maxY, online->minY, online->cellHeight, online->rows);
+    for (int row = minRow; row <= maxRow; row++) {
+        for (int column = minColumn; column <= maxColumn; column++) {
+            int cell = row * online->columns + column;
+            for (int k = online->cellStart[cell]; k < online->cellStart[cell + 1]; k++) {
+                int j = online->cellTowers[k];
+                if (towers->x[j] >= box.minX && towers->x[j] <= box.maxX && 
+                    towers->y[j] >= box.minY && towers->y[j] <= box.maxY) {
+                    online->candidates[online->candidatesNum++] = j;
+                }
+            }
+        }
+    }
+    if (!face->isBounded) {
+        for (int k = 0; k < online->straysNum; k++) {
+            online->candidates[online->candidatesNum++] = online->strays[k];
+        }
+    }
+    if (minRow != maxRow || minColumn != maxColumn || (!face->isBounded && online->straysNum > 0)) {
+        qsort(online->candidates, online->candidatesNum, sizeof(int), compareTowers);
+    }
+}
+
+/* Rebuild the list of a face from the candidates that lie in it as it is now */
+static void refillFace(online_t *online, int faceIdx) {
+
+    cachedFace_t *face = NULL;
+
+    gatherCandidates(online, faceIdx);
+    face = cacheFace(online->cache, faceIdx);
+
+    for (int k = 0; k < online->candidatesNum; k++) {
+        online->scratchX[k] = online->towers->x[online->candidates[k]];
+        online->scratchY[k] = online->towers->y[online->candidates[k]];
+    }
+    classifyBatch(face->planes, face->planesNum, online->scratchX, online->scratchY, online->candidatesNum,
+                  online->isInside);
+
+    online->faces[faceIdx].towersNum = 0;
+    online->faces[faceIdx].population = 0;
+    for (int k = 0; k < online->candidatesNum; k++) {
+        if (online->isInside[k]) {
+            addFaceTower(online, faceIdx, online->candidates[k]);
+        }
+    }
+}
+
+/* Split a face and bring the lists of the faces whose edges changed up to date: the two halves and the
+   faces across the two split edges, which gain a vertex. Each is re-tested against the watchtowers near
+   it only, so a split costs time in proportion to the faces it touches. Returns the split face, NO_FACE
+   if the split is invalid */
+int splitOnline(online_t *online, int startSplit, int endSplit) {
+
+    dcel_t *dcel = online->dcel;
+    int splitFace, newFace, touched[6];
+
+    splitFace = applySplit(dcel, startSplit, endSplit);
+    if (splitFace == NO_FACE) {
+        return NO_FACE;
+    }
+    newFace = dcel->facesNum - 1;
+    growFaces(online);
+
+    touched[0] = splitFace;
+    touched[1] = newFace;
+    touched[2] = dcel->halfEdges[2 * startSplit].faceIdx;
+    touched[3] = dcel->halfEdges[TWIN(2 * startSplit)].faceIdx;
+    touched[4] = dcel->halfEdges[2 * endSplit].faceIdx;
+    touched[5] = dcel->halfEdges[TWIN(2 * endSplit)].faceIdx;
+    for (int n = 0; n < 6; n++) {
+        int isRepeated = 0;
+        for (int m = 0; m < n; m++) {
+            isRepeated |= touched[m] == touched[n];
+        }
+        if (touched[n] != NO_FACE && !isRepeated) {
+            refillFace(online, touched[n]);
+        }
+    }
+
+    return splitFace;
+}
+
+/* Roll the dcel back to a checkpoint one split at a time, noting the faces each undone split rewrote while
+   they still have the indices it saw, then bring the lists of those that remain up to date. Returns the
+   number of splits undone, -1 if there is no such checkpoint or it is no longer valid */
+int rollbackOnline(online_t *online, int checkpoint) {
+
+    dcel_t *dcel = online->dcel;
+    int undoneNum, touchedNum = 0, *touched = NULL;
+
+    if (!isCheckpoint(dcel, checkpoint)) {
+        return -1;
+    }
+    undoneNum = dcel->journalNum - checkpoint;
+    touched = (int *) malloc((3 * undoneNum + 1) * sizeof(int));
+    assert(touched);
+
+    while (dcel->journalNum > checkpoint) {
+        splitRecord_t *record = &(dcel->journal[dcel->journalNum - 1]);
+        touched[touchedNum++] = record->splitFace;
+        touched[touchedNum++] = dcel->halfEdges[TWIN(record->startHalfEdge)].faceIdx;
+        touched[touchedNum++] = dcel->halfEdges[TWIN(record->endHalfEdge)].faceIdx;
+        undoLastSplit(dcel);
+    }
+    /* Nothing is left to undo, this drops the checkpoints past this one */
+    rollbackDcel(dcel, checkpoint);
+
+    /* Faces made since the checkpoint are gone, the rest are refilled once each */
+    qsort(touched, touchedNum, sizeof(int), compareTowers);
+    for (int k = 0; k < touchedNum; k++) {
+        if (touched[k] != NO_FACE && touched[k] < dcel->facesNum && (k == 0 || touched[k] != touched[k - 1])) {
+            refillFace(online, touched[k]);
+        }
+    }
+
+    free(touched);
+    return undoneNum;
+}
+
+/* Write the watchtowers of a face in the same form as the batch output */
+static void writeFace(online_t *online, int faceIdx, FILE *out) {
+
+    faceTowers_t *face = &(online->faces[faceIdx]);
+
+    appendInt(&(online->output), faceIdx);
+    APPEND_LITERAL(&(online->output), "\n");
+    for (int k = 0; k < face->towersNum; k++) {
+        appendTower(&(online->output), online->towers, face->towers[k]);
+    }
+    flushText(&(online->output), out);
+}
+
+/* Read commands one per line and answer each as it comes:
+     split A B   split the face shared by edges A and B
+     query F     population served in face F
+     list F      watchtowers in face F
+     checkpoint  a checkpoint of the dcel as it is now, to roll back to
+     rollback C  undo every split since checkpoint C
+   Bad commands are reported on stderr and skipped */
+void runOnline(online_t *online, FILE *in, FILE *out) {
+
+    char line[LINE_SIZE], command[COMMAND_SIZE];
+    int first, second, fields;
+
+    while (fgets(line, LINE_SIZE, in) != NULL) {
+        fields = sscanf(line, "%15s %d %d", command, &first, &second);
+        if (fields < 1) {
+            continue;
+        }
+        if (strcmp(command, "split") == 0 && fields == 3) {
+            int splitFace = splitOnline(online, first, second);
+            if (splitFace == NO_FACE) {
+                fprintf(stderr, "Edges %d and %d do not share a face\n", first, second);
+            } else {
+                fprintf(out, "Face %d split into faces %d and %d\n", splitFace, splitFace,
+                        online->dcel->facesNum - 1);
+            }
+        } else if ((strcmp(command, "query") == 0 || strcmp(command, "list") == 0) && fields == 2) {
+            if (first < 0 || first >= online->dcel->facesNum) {
+                fprintf(stderr, "There is no face %d\n", first);
+            } else if (command[0] == 'q') {
+                fprintf(out, "Face %d population served: %lld\n", first, online->faces[first].population);
+            } else {
+                writeFace(online, first, out);
+            }
+        } else if (strcmp(command, "checkpoint") == 0 && fields == 1) {
+            fprintf(out, "Checkpoint %d\n", checkpointDcel(online->dcel));
+        } else if (strcmp(command, "rollback") == 0 && fields == 2) {
+            int undoneNum = rollbackOnline(online, first);
+            if (undoneNum < 0) {
+                fprintf(stderr, "There is no checkpoint %d, or a rollback has undone it\n", first);
+            } else {
+                fprintf(out, "Rolled back %d splits to checkpoint %d\n", undoneNum, first);
+            }
+        } else {
+            fprintf(stderr, "Unknown command: %s", line);
+        }
+        fflush(out);
+    }
+}
+
+/* Free the face lists, the dcel and watchtowers stay with the caller */
+void freeOnline(online_t *online) {
+
+    for (int i = 0; i < online->maxFaces; i++) {
+        free(online->faces[i].towers);
+    }
+    free(online->faces);
+    free(online->cellStart);
+    free(online->cellTowers);
+    free(online->strays);
+    free(online->candidates);
+    free(online->scratchX);
+    free(online->scratchY);
+    free(online->isInside);
+    freeFaceCache(online->cache);
+    freeText(&(online->output));
+    free(online);
+}
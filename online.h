@@ -0,0 +1,50 @@
+#ifndef ONLINE_H
+#define ONLINE_H
+
+    #include "list.h"
+    #include "halfplane.h"
+    #include "watchtower.h"
+    #include "locate.h"
+    #include "writer.h"
+
+    /* Watchtowers in a face, in input order, and the population they serve */
+    typedef struct {
+        int towersNum;
+        int maxTowers;
+        int *towers;
+        long long population;
+    } faceTowers_t;
+
+    /* A dcel whose faces keep their watchtowers up to date as they are split. Watchtowers never move, so
+       they sit in a fixed uniform grid that gives the candidates for a face from its padded bounding box;
+       strays lie outside the frame of the face cache, or have no coordinates, and are only candidates
+       for faces without a bound. The scratch arrays hold the candidates and coordinates of the face being
+       re-tested, whose box and half-planes come from the face cache */
+    typedef struct {
+        dcel_t *dcel;
+        towertable_t *towers;
+        int maxFaces;
+        faceTowers_t *faces;
+        double pad;
+        int columns, rows;
+        double minX, minY;
+        double cellWidth, cellHeight;
+        int *cellStart;
+        int *cellTowers;
+        int straysNum;
+        int *strays;
+        int candidatesNum;
+        int *candidates;
+        double *scratchX, *scratchY;
+        unsigned char *isInside;
+        faceCache_t *cache;
+        textBuffer_t output;
+    } online_t;
+
+    online_t *startOnline(dcel_t *dcel, towertable_t *towers, int threadsNum);
+    int splitOnline(online_t *online, int startSplit, int endSplit);
+    int rollbackOnline(online_t *online, int checkpoint);
+    void runOnline(online_t *online, FILE *in, FILE *out);
+    void freeOnline(online_t *online);
+
+#endif
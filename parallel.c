@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <pthread.h>
+#include "parallel.h"
+#include "stats.h"
+
+typedef struct {
+    int tasksNum;
+    int nextTask;
+    task_t task;
+    void *arg;
+} work_t;
+
+typedef struct {
+    work_t *work;
+    int threadIdx;
+} worker_t;
+
+/* Threads kept waiting between calls so a parallelFor does not pay for starting them. Each call is a new
+   generation; pool thread t takes part in it if t < threadsNum, and running counts those not done yet */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    int isBusy;
+    int threadsNum;
+    int poolSize;
+    int running;
+    long generation;
+    work_t *work;
+} pool_t;
+
+static pool_t pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+/* Take tasks until there are none left */
+static void runTasks(work_t *work, int threadIdx) {
+
+    int taskIdx;
+
+    while ((taskIdx = __atomic_fetch_add(&(work->nextTask), 1, __ATOMIC_RELAXED)) < work->tasksNum) {
+        work->task(work->arg, taskIdx, threadIdx);
+    }
+
+    STATS_FLUSH();
+}
+
+/* Run the tasks of a thread started for one call */
+static void *runWorker(void *arg) {
+
+    worker_t *worker = (worker_t *) arg;
+
+    runTasks(worker->work, worker->threadIdx);
+    return NULL;
+}
+
+/* Wait for each generation of the pool and run its tasks if this thread takes part */
+static void *runPoolThread(void *arg) {
+
+    int threadIdx = (int) (intptr_t) arg;
+    long seen = 0;
+    work_t *work;
+
+    pthread_mutex_lock(&(pool.lock));
+    while (1) {
+        while (pool.generation == seen) {
+            pthread_cond_wait(&(pool.wake), &(pool.lock));
+        }
+        seen = pool.generation;
+        if (threadIdx >= pool.threadsNum) {
+            continue;
+        }
+        work = pool.work;
+        pthread_mutex_unlock(&(pool.lock));
+
+        runTasks(work, threadIdx);
+
+        pthread_mutex_lock(&(pool.lock));
+        if (--pool.running == 0) {
+            pthread_cond_signal(&(pool.done));
+        }
+    }
+
+    return NULL;
+}
+
+/* Run the work over threads started for this call only, for when the pool is in use by another call */
+static void spawnTasks(work_t *work, int threadsNum) {
+
+    pthread_t *threads = (pthread_t *) malloc(threadsNum * sizeof(pthread_t));
+    assert(threads);
+    worker_t *workers = (worker_t *) malloc(threadsNum * sizeof(worker_t));
+    assert(workers);
+
+    for (int t = 0; t < threadsNum; t++) {
+        workers[t].work = work;
+        workers[t].threadIdx = t;
+    }
+    for (int t = 1; t < threadsNum; t++) {
+        if (pthread_create(&(threads[t]), NULL, runWorker, &(workers[t])) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+    runTasks(work, 0);
+    for (int t = 1; t < threadsNum; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    free(workers);
+    free(threads);
+}
+
+/* Run tasks over a number of threads, the calling thread being thread 0. Tasks are handed out
+   in order but may finish in any order, so callers keep per-thread results and merge them.
+   The other threads come from the pool, which grows to the most threads asked for; a call made
+   while the pool is running another, such as from the watchtower loader, starts its own */
+void parallelFor(int tasksNum, int threadsNum, task_t task, void *arg) {
+
+    work_t work = {tasksNum, 0, task, arg};
+    pthread_t thread;
+
+    if (threadsNum > tasksNum) {
+        threadsNum = tasksNum;
+    }
+    if (threadsNum <= 1) {
+        for (int i = 0; i < tasksNum; i++) {
+            task(arg, i, 0);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&(pool.lock));
+    if (pool.isBusy) {
+        pthread_mutex_unlock(&(pool.lock));
+        spawnTasks(&work, threadsNum);
+        return;
+    }
+    pool.isBusy = 1;
+    for (; pool.poolSize < threadsNum - 1; pool.poolSize++) {
+        if (pthread_create(&thread, NULL, runPoolThread, (void *) (intptr_t) (pool.poolSize + 1)) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(thread);
+    }
+    pool.work = &work;
+    pool.threadsNum = threadsNum;
+    pool.running = threadsNum - 1;
+    pool.generation++;
+    pthread_cond_broadcast(&(pool.wake));
+    pthread_mutex_unlock(&(pool.lock));
+
+    runTasks(&work, 0);
+
+    pthread_mutex_lock(&(pool.lock));
+    while (pool.running > 0) {
+        pthread_cond_wait(&(pool.done), &(pool.lock));
+    }
+    pool.isBusy = 0;
+    pthread_mutex_unlock(&(pool.lock));
+}
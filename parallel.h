@@ -0,0 +1,9 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+    /* Runs task(arg, taskIdx, threadIdx) for every task, threadIdx tells which thread runs it */
+    typedef void (*task_t)(void *arg, int taskIdx, int threadIdx);
+
+    void parallelFor(int tasksNum, int threadsNum, task_t task, void *arg);
+
+#endif
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "list.h"
+#include "snapshot.h"
+
+/* Write a snapshot of a dcel, returns 0 if any write failed */
+int saveDcel(dcel_t *dcel, FILE *file) {
+
+    snapshotHeader_t header;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.headerSize = sizeof(header);
+    header.verticesNum = dcel->verticesNum;
+    header.edgesNum = dcel->edgesNum;
+    header.facesNum = dcel->facesNum;
+
+    return fwrite(&header, sizeof(header), 1, file) == 1 &&
+           fwrite(dcel->vertices, sizeof(vertex_t), dcel->verticesNum, file) == (size_t) dcel->verticesNum &&
+           fwrite(dcel->edges, sizeof(edge_t), dcel->edgesNum, file) == (size_t) dcel->edgesNum &&
+           fwrite(dcel->faces, sizeof(face_t), dcel->facesNum, file) == (size_t) dcel->facesNum &&
+           fwrite(dcel->halfEdges, sizeof(halfedge_t), 2 * dcel->edgesNum, file) == 2 * (size_t) dcel->edgesNum &&
+           fflush(file) == 0;
+}
+
+/* Check that every index in a loaded dcel is in range, that next and prev undo each other and twins run
+   between the same vertices, that every face cycle closes with as many half-edges as its face counts
+   and that the half-edges outside the polygon form one closed cycle, so a damaged snapshot cannot send a
+   walk astray */
+static int isValidDcel(dcel_t *dcel) {
+
+    long steps = 0, outsideNum = 0;
+    int outsideStart = -1;
+
+    for (int e = 0; e < dcel->edgesNum; e++) {
+        if (dcel->edges[e].halfEdge != 2 * e) {
+            return 0;
+        }
+    }
+    for (int i = 0; i < dcel->facesNum; i++) {
+        if (dcel->faces[i].halfEdge < 0 || dcel->faces[i].halfEdge >= 2 * dcel->edgesNum ||
+            dcel->faces[i].halfEdgesNum < 1 || dcel->faces[i].stamp < 0) {
+            return 0;
+        }
+    }
+    for (int h = 0; h < 2 * dcel->edgesNum; h++) {
+        halfedge_t *halfEdge = &(dcel->halfEdges[h]);
+        if (halfEdge->startVertexIdx < 0 || halfEdge->startVertexIdx >= dcel->verticesNum ||
+            halfEdge->endVertexIdx < 0 || halfEdge->endVertexIdx >= dcel->verticesNum ||
+            halfEdge->faceIdx < NO_FACE || halfEdge->faceIdx >= dcel->facesNum || halfEdge->edgeIdx != h / 2 ||
+            halfEdge->next < 0 || halfEdge->next >= 2 * dcel->edgesNum ||
+            halfEdge->prev < 0 || halfEdge->prev >= 2 * dcel->edgesNum) {
+            return 0;
+        }
+    }
+    for (int h = 0; h < 2 * dcel->edgesNum; h++) {
+        halfedge_t *halfEdge = &(dcel->halfEdges[h]), *twin = &(dcel->halfEdges[TWIN(h)]);
+        if (dcel->halfEdges[halfEdge->next].prev != h || dcel->halfEdges[halfEdge->prev].next != h ||
+            dcel->halfEdges[halfEdge->next].startVertexIdx != halfEdge->endVertexIdx ||
+            twin->startVertexIdx != halfEdge->endVertexIdx || twin->endVertexIdx != halfEdge->startVertexIdx ||
+            (twin->faceIdx == NO_FACE && halfEdge->faceIdx == NO_FACE)) {
+            return 0;
+        }
+        if (halfEdge->faceIdx == NO_FACE) {
+            outsideStart = outsideStart < 0 ? h : outsideStart;
+            outsideNum++;
+        }
+    }
+    for (int i = 0; i < dcel->facesNum; i++) {
+        int start = dcel->faces[i].halfEdge, tmp = start, halfEdgesNum = 0;
+        do {
+            /* Face cycles are disjoint, so all of them together take at most one step per half-edge */
+            if (dcel->halfEdges[tmp].faceIdx != i || ++steps > 2 * (long) dcel->edgesNum) {
+                return 0;
+            }
+            halfEdgesNum++;
+            tmp = dcel->halfEdges[tmp].next;
+        } while (tmp != start);
+        if (halfEdgesNum != dcel->faces[i].halfEdgesNum) {
+            return 0;
+        }
+    }
+
+    /* The rest are outside, and must all lie on the one cycle around the polygon */
+    if (outsideStart < 0 || steps + outsideNum != 2 * (long) dcel->edgesNum) {
+        return 0;
+    }
+    for (int tmp = dcel->halfEdges[outsideStart].next; tmp != outsideStart; tmp = dcel->halfEdges[tmp].next) {
+        if (dcel->halfEdges[tmp].faceIdx != NO_FACE || --outsideNum < 1) {
+            return 0;
+        }
+    }
+    return outsideNum == 1;
+}
+
+/* Load a dcel from a snapshot. The file is mapped into memory and each array is copied out in one go,
+   sized exactly so that later splits grow it geometrically. Returns NULL if the file is not a snapshot
+   this version can read */
+dcel_t *loadDcel(FILE *file) {
+
+    struct stat status;
+    snapshotHeader_t header;
+    char *data = NULL, *array = NULL;
+    size_t size, expected;
+    dcel_t *dcel = NULL;
+
+    if (fstat(fileno(file), &status) != 0 || !S_ISREG(status.st_mode) || status.st_size < (off_t) sizeof(header)) {
+        return NULL;
+    }
+    size = status.st_size;
+    data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+
+    /* Check the header before trusting any of the counts */
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.version != SNAPSHOT_VERSION ||
+        header.byteOrder != SNAPSHOT_BYTE_ORDER || header.headerSize != sizeof(header) ||
+        header.verticesNum < 1 || header.edgesNum < 1 || header.facesNum < 1) {
+        munmap(data, size);
+        return NULL;
+    }
+    expected = sizeof(header) + (size_t) header.verticesNum * sizeof(vertex_t) +
+               (size_t) header.edgesNum * (sizeof(edge_t) + 2 * sizeof(halfedge_t)) +
+               (size_t) header.facesNum * sizeof(face_t);
+    if (size != expected) {
+        munmap(data, size);
+        return NULL;
+    }
+
+    dcel = (dcel_t *) malloc(sizeof(dcel_t));
+    assert(dcel);
+    dcel->verticesNum = dcel->maxVertices = header.verticesNum;
+    dcel->edgesNum = dcel->maxEdges = header.edgesNum;
+    dcel->facesNum = dcel->maxFaces = header.facesNum;
+    dcel->vertices = (vertex_t *) malloc(dcel->maxVertices * sizeof(vertex_t));
+    assert(dcel->vertices);
+    dcel->edges = (edge_t *) malloc(dcel->maxEdges * sizeof(edge_t));
+    assert(dcel->edges);
+    dcel->faces = (face_t *) malloc(dcel->maxFaces * sizeof(face_t));
+    assert(dcel->faces);
+    dcel->halfEdges = (halfedge_t *) malloc(2 * dcel->maxEdges * sizeof(halfedge_t));
+    assert(dcel->halfEdges);
+    dcel->allocations = 5;
+    dcel->isJournaling = 0;
+    dcel->journalNum = dcel->maxJournal = 0;
+    dcel->journal = NULL;
+    dcel->checkpointsNum = dcel->maxCheckpoints = 0;
+    dcel->checkpoints = NULL;
+
+    array = data + sizeof(header);
+    memcpy(dcel->vertices, array, dcel->verticesNum * sizeof(vertex_t));
+    array += dcel->verticesNum * sizeof(vertex_t);
+    memcpy(dcel->edges, array, dcel->edgesNum * sizeof(edge_t));
+    array += dcel->edgesNum * sizeof(edge_t);
+    memcpy(dcel->faces, array, dcel->facesNum * sizeof(face_t));
+    array += dcel->facesNum * sizeof(face_t);
+    memcpy(dcel->halfEdges, array, 2 * dcel->edgesNum * sizeof(halfedge_t));
+    munmap(data, size);
+
+    if (!isValidDcel(dcel)) {
+        freeList(dcel);
+        return NULL;
+    }
+
+    /* Carry on counting changes from the latest face stamp */
+    dcel->changesNum = 0;
+    for (int i = 0; i < dcel->facesNum; i++) {
+        if (dcel->faces[i].stamp > dcel->changesNum) {
+            dcel->changesNum = dcel->faces[i].stamp;
+        }
+    }
+
+    return dcel;
+}
@@ -0,0 +1,27 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+    #include <stdint.h>
+    #include "list.h"
+
+    #define SNAPSHOT_MAGIC "DCEL"
+    #define SNAPSHOT_VERSION 2
+    #define SNAPSHOT_BYTE_ORDER 0x01020304
+
+    /* A snapshot is this header followed by the vertices, edges, faces and half-edges of a dcel, each
+       array exactly as it is laid out in memory */
+    typedef struct {
+        char magic[4];
+        uint32_t version;
+        uint32_t byteOrder;
+        uint32_t headerSize;
+        int32_t verticesNum;
+        int32_t edgesNum;
+        int32_t facesNum;
+        int32_t reserved;
+    } snapshotHeader_t;
+
+    int saveDcel(dcel_t *dcel, FILE *file);
+    dcel_t *loadDcel(FILE *file);
+
+#endif
@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "list.h"
+#include "splitlog.h"
+
+/* Write splits as a binary split log, returns 0 if any write failed */
+int saveSplitLog(splitPair_t *splits, int splitsNum, FILE *file) {
+
+    splitLogHeader_t header;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SPLITLOG_MAGIC, sizeof(header.magic));
+    header.version = SPLITLOG_VERSION;
+    header.byteOrder = SPLITLOG_BYTE_ORDER;
+    header.headerSize = sizeof(header);
+    header.splitsNum = splitsNum;
+
+    return fwrite(&header, sizeof(header), 1, file) == 1 &&
+           fwrite(splits, sizeof(splitPair_t), splitsNum, file) == (size_t) splitsNum &&
+           fflush(file) == 0;
+}
+
+/* Map a binary split log into memory. The splits are used in place, so a log of any length is never parsed
+   or copied. Returns NULL if the file is not a split log this version can read */
+splitLog_t *openSplitLog(FILE *file) {
+
+    struct stat status;
+    splitLogHeader_t header;
+    splitLog_t *log = NULL;
+    char *data = NULL;
+    size_t size;
+
+    if (fstat(fileno(file), &status) != 0 || !S_ISREG(status.st_mode) || status.st_size < (off_t) sizeof(header)) {
+        return NULL;
+    }
+    size = status.st_size;
+    data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, SPLITLOG_MAGIC, sizeof(header.magic)) != 0 || header.version != SPLITLOG_VERSION ||
+        header.byteOrder != SPLITLOG_BYTE_ORDER || header.headerSize != sizeof(header) || header.splitsNum < 0 ||
+        size != sizeof(header) + (size_t) header.splitsNum * sizeof(splitPair_t)) {
+        munmap(data, size);
+        return NULL;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    log = (splitLog_t *) malloc(sizeof(splitLog_t));
+    assert(log);
+    log->data = data;
+    log->size = size;
+    log->splitsNum = header.splitsNum;
+    log->splits = (splitPair_t *) (data + sizeof(header));
+
+    return log;
+}
+
+/* Unmap a split log */
+void closeSplitLog(splitLog_t *log) {
+
+    munmap(log->data, log->size);
+    free(log);
+}
@@ -0,0 +1,34 @@
+#ifndef SPLITLOG_H
+#define SPLITLOG_H
+
+    #include <stddef.h>
+    #include <stdint.h>
+    #include "list.h"
+
+    #define SPLITLOG_MAGIC "SPLT"
+    #define SPLITLOG_VERSION 1
+    #define SPLITLOG_BYTE_ORDER 0x01020304
+
+    /* A split log is this header followed by the split pairs as 32-bit integers */
+    typedef struct {
+        char magic[4];
+        uint32_t version;
+        uint32_t byteOrder;
+        uint32_t headerSize;
+        int32_t splitsNum;
+        int32_t reserved;
+    } splitLogHeader_t;
+
+    /* A split log mapped into memory, its splits point straight into the mapping */
+    typedef struct {
+        char *data;
+        size_t size;
+        int splitsNum;
+        splitPair_t *splits;
+    } splitLog_t;
+
+    int saveSplitLog(splitPair_t *splits, int splitsNum, FILE *file);
+    splitLog_t *openSplitLog(FILE *file);
+    void closeSplitLog(splitLog_t *log);
+
+#endif
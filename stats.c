@@ -0,0 +1,180 @@
+#ifdef STATS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "list.h"
+#include "stats.h"
+
+#define HISTOGRAM_BUCKETS 32
+
+__thread counters_t threadCounters;
+
+static counters_t totals;
+static double phaseStart[PHASES_NUM], phaseSeconds[PHASES_NUM];
+static long long allocationsNum, heapBytes, peakHeapBytes;
+
+static char *phaseNames[PHASES_NUM] = {"readWatchtowers", "waitWatchtowers", "buildDcel", "readSplits",
+                                       "applySplits", "buildGrid", "locate", "groupMatches", "writeFaces",
+                                       "online"};
+
+/* Seconds on the monotonic clock */
+static double now(void) {
+
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/* Each phase is timed on one thread, reading watchtowers may overlap the phases of the main thread */
+void startPhase(int phase) {
+
+    phaseStart[phase] = now();
+}
+
+void stopPhase(int phase) {
+
+    phaseSeconds[phase] += now() - phaseStart[phase];
+}
+
+/* Raise a total to a value if it is larger */
+static void raiseTo(long long *total, long long value) {
+
+    long long current = __atomic_load_n(total, __ATOMIC_RELAXED);
+
+    while (value > current &&
+           !__atomic_compare_exchange_n(total, &current, value, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void flushWalk(walkStats_t *total, walkStats_t *walk) {
+
+    __atomic_fetch_add(&(total->walksNum), walk->walksNum, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&(total->steps), walk->steps, __ATOMIC_RELAXED);
+    raiseTo(&(total->longest), walk->longest);
+}
+
+/* Add the counts of the calling thread into the totals and start it again from zero */
+void flushStats(void) {
+
+    counters_t *counters = &threadCounters;
+
+    __atomic_fetch_add(&(totals.halfPlaneTests), counters->halfPlaneTests, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&(totals.coefficientTests), counters->coefficientTests, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&(totals.classifyBatches), counters->classifyBatches, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&(totals.classifiedPoints), counters->classifiedPoints, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&(totals.towerWalkSteps), counters->towerWalkSteps, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&(totals.unboundedFaces), counters->unboundedFaces, __ATOMIC_RELAXED);
+    flushWalk(&(totals.splitWalks), &(counters->splitWalks));
+    flushWalk(&(totals.faceWalks), &(counters->faceWalks));
+    *counters = (counters_t) {0};
+}
+
+/* The stats build links with --wrap for malloc, calloc, realloc and free, so every allocation of the program
+   passes through here and is counted along with the bytes in use */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t number, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+void __real_free(void *pointer);
+
+static void addHeap(long long bytes) {
+
+    raiseTo(&peakHeapBytes, __atomic_add_fetch(&heapBytes, bytes, __ATOMIC_RELAXED));
+}
+
+void *__wrap_malloc(size_t size) {
+
+    void *pointer = __real_malloc(size);
+
+    __atomic_fetch_add(&allocationsNum, 1, __ATOMIC_RELAXED);
+    addHeap(malloc_usable_size(pointer));
+    return pointer;
+}
+
+void *__wrap_calloc(size_t number, size_t size) {
+
+    void *pointer = __real_calloc(number, size);
+
+    __atomic_fetch_add(&allocationsNum, 1, __ATOMIC_RELAXED);
+    addHeap(malloc_usable_size(pointer));
+    return pointer;
+}
+
+void *__wrap_realloc(void *pointer, size_t size) {
+
+    long long oldSize = malloc_usable_size(pointer);
+    void *moved = __real_realloc(pointer, size);
+
+    /* A failed realloc leaves the old block in place */
+    if (moved != NULL || size == 0) {
+        __atomic_fetch_add(&allocationsNum, 1, __ATOMIC_RELAXED);
+        addHeap((long long) malloc_usable_size(moved) - oldSize);
+    }
+    return moved;
+}
+
+void __wrap_free(void *pointer) {
+
+    __atomic_fetch_sub(&heapBytes, (long long) malloc_usable_size(pointer), __ATOMIC_RELAXED);
+    __real_free(pointer);
+}
+
+static void writeWalk(FILE *file, char *name, walkStats_t *walk) {
+
+    fprintf(file, "  \"%s\": {\"walks\": %lld, \"halfEdges\": %lld, \"longest\": %lld},\n", name, walk->walksNum,
+            walk->steps, walk->longest);
+}
+
+/* Write the timers and counters as JSON, with a histogram of the half-edges per face of the dcel in
+   power of two buckets: bucket b counts the faces with more than 2^(b - 1) and at most 2^b half-edges */
+void writeStats(FILE *file, dcel_t *dcel) {
+
+    long long buckets[HISTOGRAM_BUCKETS] = {0}, halfEdgesNum = 0;
+    struct rusage usage;
+    int firstBucket = HISTOGRAM_BUCKETS, lastBucket = 0;
+
+    flushStats();
+    for (int i = 0; i < dcel->facesNum; i++) {
+        int bucket = 0;
+        while (bucket < HISTOGRAM_BUCKETS - 1 && (1ll << bucket) < dcel->faces[i].halfEdgesNum) {
+            bucket++;
+        }
+        buckets[bucket]++;
+        halfEdgesNum += dcel->faces[i].halfEdgesNum;
+        if (bucket < firstBucket) {
+            firstBucket = bucket;
+        }
+        if (bucket > lastBucket) {
+            lastBucket = bucket;
+        }
+    }
+    getrusage(RUSAGE_SELF, &usage);
+
+    fprintf(file, "{\n  \"seconds\": {");
+    for (int p = 0; p < PHASES_NUM; p++) {
+        fprintf(file, "%s\"%s\": %.6f", p ? ", " : "", phaseNames[p], phaseSeconds[p]);
+    }
+    fprintf(file, "},\n");
+    fprintf(file, "  \"isOfHalfPlane\": %lld,\n", totals.halfPlaneTests);
+    fprintf(file, "  \"isOfHalfPlaneCoefficients\": %lld,\n", totals.coefficientTests);
+    fprintf(file, "  \"classifyBatch\": {\"batches\": %lld, \"points\": %lld},\n", totals.classifyBatches,
+            totals.classifiedPoints);
+    writeWalk(file, "splitWalks", &(totals.splitWalks));
+    writeWalk(file, "faceWalks", &(totals.faceWalks));
+    fprintf(file, "  \"towerWalkSteps\": %lld,\n", totals.towerWalkSteps);
+    fprintf(file, "  \"unboundedFaces\": %lld,\n", totals.unboundedFaces);
+    fprintf(file, "  \"faces\": {\"count\": %d, \"halfEdges\": %lld, \"histogram\": [", dcel->facesNum,
+            halfEdgesNum);
+    for (int b = firstBucket; b <= lastBucket; b++) {
+        fprintf(file, "%s{\"upTo\": %lld, \"faces\": %lld}", b > firstBucket ? ", " : "", 1ll << b, buckets[b]);
+    }
+    fprintf(file, "]},\n");
+    fprintf(file, "  \"allocations\": {\"calls\": %lld, \"dcel\": %ld, \"peakHeapBytes\": %lld},\n",
+            allocationsNum, dcel->allocations, peakHeapBytes);
+    fprintf(file, "  \"peakResidentKilobytes\": %ld\n}\n", usage.ru_maxrss);
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef STATS_H
+#define STATS_H
+
+    #include <stdio.h>
+    #include "list.h"
+
+    /* Phases of a run that are timed */
+    #define PHASE_READ_TOWERS 0
+    #define PHASE_WAIT_TOWERS 1
+    #define PHASE_BUILD_DCEL 2
+    #define PHASE_READ_SPLITS 3
+    #define PHASE_APPLY_SPLITS 4
+    #define PHASE_BUILD_GRID 5
+    #define PHASE_LOCATE 6
+    #define PHASE_GROUP 7
+    #define PHASE_WRITE 8
+    #define PHASE_ONLINE 9
+    #define PHASES_NUM 10
+
+    /* Counters and timers of the hot paths, only compiled in with -DSTATS (make voronoi1-stats). Without
+       it the macros below expand to nothing but their plain arguments, so a normal build pays nothing for
+       them. The stats build also wraps malloc, calloc, realloc and free to count allocations and peak heap */
+    #ifdef STATS
+
+        /* Walks along face cycles: how many, how many half-edges in all and the longest */
+        typedef struct {
+            long long walksNum;
+            long long steps;
+            long long longest;
+        } walkStats_t;
+
+        /* Counts of one thread, added into the totals when its parallelFor finishes, so the hot paths
+           never touch shared memory */
+        typedef struct {
+            long long halfPlaneTests;
+            long long coefficientTests;
+            long long classifyBatches;
+            long long classifiedPoints;
+            walkStats_t splitWalks;
+            walkStats_t faceWalks;
+            long long towerWalkSteps;
+            long long unboundedFaces;
+        } counters_t;
+
+        extern __thread counters_t threadCounters;
+
+        #define STATS_COUNT(counter, amount) (threadCounters.counter += (amount))
+        #define STATS_WALK(walk, length) addWalk(&(threadCounters.walk), (length))
+        #define STATS_START(phase) startPhase(phase)
+        #define STATS_STOP(phase) stopPhase(phase)
+        #define STATS_FLUSH() flushStats()
+
+        static inline void addWalk(walkStats_t *walk, long long length) {
+            walk->walksNum++;
+            walk->steps += length;
+            if (length > walk->longest) {
+                walk->longest = length;
+            }
+        }
+
+        void startPhase(int phase);
+        void stopPhase(int phase);
+        void flushStats(void);
+        void writeStats(FILE *file, dcel_t *dcel);
+
+    #else
+
+        #define STATS_COUNT(counter, amount) ((void) (amount))
+        #define STATS_WALK(walk, length) ((void) (length))
+        #define STATS_START(phase) ((void) 0)
+        #define STATS_STOP(phase) ((void) 0)
+        #define STATS_FLUSH() ((void) 0)
+
+    #endif
+
+#endif
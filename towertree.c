@@ -0,0 +1,455 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+#include "watchtower.h"
+#include "locate.h"
+#include "towertree.h"
+#include "writer.h"
+#include "parallel.h"
+
+#define LEAF_TOWERS 8
+#define QUERIES 64
+#define QUERIES_PER_TASK 1024
+#define TASKS_PER_THREAD 4
+#define COMMAND_SIZE 16
+#define LINE_SIZE 256
+
+/* A watchtower while the tree is built, kept together so selection reads coordinates in sequence */
+typedef struct {
+    double x, y;
+    int tower;
+} towerPoint_t;
+
+#define COORD(point, isX) ((isX) ? (point).x : (point).y)
+#define SWAP_POINTS(first, second) do { towerPoint_t tmp = (first); (first) = (second); (second) = tmp; } while (0)
+
+/* Rearrange points[start, end) so that position k holds the point that sorting on x (or y) would put there,
+   with no larger coordinate before it and no smaller one after it */
+static void selectPoint(towerPoint_t *points, int isX, int start, int end, int k) {
+
+    while (end - start > 1) {
+        int first = start, last = end - 1, middle = start + (end - start) / 2;
+        double pivot;
+
+        /* Median of three as the pivot */
+        if (COORD(points[middle], isX) < COORD(points[first], isX)) {
+            SWAP_POINTS(points[middle], points[first]);
+        }
+        if (COORD(points[last], isX) < COORD(points[first], isX)) {
+            SWAP_POINTS(points[last], points[first]);
+        }
+        if (COORD(points[last], isX) < COORD(points[middle], isX)) {
+            SWAP_POINTS(points[last], points[middle]);
+        }
+        pivot = COORD(points[middle], isX);
+
+        while (first <= last) {
+            while (COORD(points[first], isX) < pivot) {
+                first++;
+            }
+            while (COORD(points[last], isX) > pivot) {
+                last--;
+            }
+            if (first <= last) {
+                SWAP_POINTS(points[first], points[last]);
+                first++;
+                last--;
+            }
+        }
+
+        /* Everything in (last, first) equals the pivot */
+        if (k <= last) {
+            end = last + 1;
+        } else if (k >= first) {
+            start = first;
+        } else {
+            return;
+        }
+    }
+}
+
+/* Widen a box to take in a point */
+static void addToBox(bbox_t *box, double targetX, double targetY) {
+
+    if (targetX < box->minX) {
+        box->minX = targetX;
+    }
+    if (targetX > box->maxX) {
+        box->maxX = targetX;
+    }
+    if (targetY < box->minY) {
+        box->minY = targetY;
+    }
+    if (targetY > box->maxY) {
+        box->maxY = targetY;
+    }
+}
+
+/* Split the run [start, end) at its median across the wider side of its cell, the part of the plane its
+   parent gave it, then work out its box and population from those of its halves. Only leaves are scanned,
+   so building takes a selection per level and no more */
+static void buildRun(towerTree_t *tree, towertable_t *towers, towerPoint_t *points, int start, int end,
+                     bbox_t cell) {
+
+    int mid = start + (end - start) / 2, lowMid = start + (mid - start) / 2, highMid = mid + 1 + (end - mid - 1) / 2;
+    int isX = cell.maxX - cell.minX >= cell.maxY - cell.minY;
+    bbox_t box = {INFINITY, INFINITY, -INFINITY, -INFINITY}, lowCell = cell, highCell = cell;
+    long long population = 0;
+
+    if (end - start <= LEAF_TOWERS) {
+        for (int k = start; k < end; k++) {
+            addToBox(&box, points[k].x, points[k].y);
+            population += towers->populationServed[points[k].tower];
+        }
+        tree->boxes[mid] = box;
+        tree->populations[mid] = population;
+        return;
+    }
+
+    selectPoint(points, isX, start, end, mid);
+    if (isX) {
+        lowCell.maxX = highCell.minX = points[mid].x;
+    } else {
+        lowCell.maxY = highCell.minY = points[mid].y;
+    }
+    buildRun(tree, towers, points, start, mid, lowCell);
+    buildRun(tree, towers, points, mid + 1, end, highCell);
+
+    box = tree->boxes[lowMid];
+    addToBox(&box, tree->boxes[highMid].minX, tree->boxes[highMid].minY);
+    addToBox(&box, tree->boxes[highMid].maxX, tree->boxes[highMid].maxY);
+    addToBox(&box, points[mid].x, points[mid].y);
+    tree->boxes[mid] = box;
+    tree->populations[mid] = tree->populations[lowMid] + tree->populations[highMid] +
+                             towers->populationServed[points[mid].tower];
+}
+
+/* Build the tree, copying coordinates and population into tree order so queries read them in sequence */
+towerTree_t *buildTowerTree(towertable_t *towers) {
+
+    towerTree_t *tree = (towerTree_t *) malloc(sizeof(towerTree_t));
+    assert(tree);
+    int towersNum = tree->towersNum = towers->towersNum;
+
+    /* One spare slot, so an empty table still gets its arrays */
+    tree->towers = (int *) malloc((towersNum + 1) * sizeof(int));
+    assert(tree->towers);
+    tree->x = (double *) malloc((towersNum + 1) * sizeof(double));
+    assert(tree->x);
+    tree->y = (double *) malloc((towersNum + 1) * sizeof(double));
+    assert(tree->y);
+    tree->population = (int *) malloc((towersNum + 1) * sizeof(int));
+    assert(tree->population);
+    tree->boxes = (bbox_t *) malloc((towersNum + 1) * sizeof(bbox_t));
+    assert(tree->boxes);
+    tree->populations = (long long *) malloc((towersNum + 1) * sizeof(long long));
+    assert(tree->populations);
+
+    towerPoint_t *points = (towerPoint_t *) malloc((towersNum + 1) * sizeof(towerPoint_t));
+    assert(points);
+    bbox_t cell = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+    for (int k = 0; k < towersNum; k++) {
+        points[k].x = towers->x[k];
+        points[k].y = towers->y[k];
+        points[k].tower = k;
+        addToBox(&cell, points[k].x, points[k].y);
+    }
+    if (towersNum > 0) {
+        buildRun(tree, towers, points, 0, towersNum, cell);
+    }
+    for (int k = 0; k < towersNum; k++) {
+        tree->towers[k] = points[k].tower;
+        tree->x[k] = points[k].x;
+        tree->y[k] = points[k].y;
+        tree->population[k] = towers->populationServed[points[k].tower];
+    }
+    free(points);
+
+    return tree;
+}
+
+static int isInBox(bbox_t *box, double targetX, double targetY) {
+
+    return targetX >= box->minX && targetX <= box->maxX && targetY >= box->minY && targetY <= box->maxY;
+}
+
+/* Population and number of towers of [start, end) inside a box, borders included */
+static long long rectangleRun(towerTree_t *tree, bbox_t *box, int start, int end, int *towersNum) {
+
+    int mid = start + (end - start) / 2;
+    bbox_t *runBox = &(tree->boxes[mid]);
+    long long population = 0;
+
+    if (runBox->minX > box->maxX || runBox->maxX < box->minX || runBox->minY > box->maxY ||
+        runBox->maxY < box->minY) {
+        return 0;
+    }
+    if (runBox->minX >= box->minX && runBox->maxX <= box->maxX && runBox->minY >= box->minY &&
+        runBox->maxY <= box->maxY) {
+        *towersNum += end - start;
+        return tree->populations[mid];
+    }
+    if (end - start <= LEAF_TOWERS) {
+        for (int k = start; k < end; k++) {
+            if (isInBox(box, tree->x[k], tree->y[k])) {
+                (*towersNum)++;
+                population += tree->population[k];
+            }
+        }
+        return population;
+    }
+
+    if (isInBox(box, tree->x[mid], tree->y[mid])) {
+        (*towersNum)++;
+        population += tree->population[mid];
+    }
+    return population + rectangleRun(tree, box, start, mid, towersNum) +
+           rectangleRun(tree, box, mid + 1, end, towersNum);
+}
+
+/* Total population served by the towers in a box, borders included, and how many there are */
+long long rectangleSum(towerTree_t *tree, bbox_t *box, int *towersNum) {
+
+    *towersNum = 0;
+    return tree->towersNum > 0 ? rectangleRun(tree, box, 0, tree->towersNum, towersNum) : 0;
+}
+
+/* Squared distances from a point to the nearest and to the farthest point of a box */
+static double nearestSquared(bbox_t *box, double targetX, double targetY) {
+
+    double dx = fmax(fmax(box->minX - targetX, targetX - box->maxX), 0);
+    double dy = fmax(fmax(box->minY - targetY, targetY - box->maxY), 0);
+
+    return dx * dx + dy * dy;
+}
+
+static double farthestSquared(bbox_t *box, double targetX, double targetY) {
+
+    double dx = fmax(targetX - box->minX, box->maxX - targetX);
+    double dy = fmax(targetY - box->minY, box->maxY - targetY);
+
+    return dx * dx + dy * dy;
+}
+
+static int isInCircle(double centreX, double centreY, double radiusSquared, double targetX, double targetY) {
+
+    return (targetX - centreX) * (targetX - centreX) + (targetY - centreY) * (targetY - centreY) <= radiusSquared;
+}
+
+/* Population and number of towers of [start, end) within a squared radius of a centre */
+static long long radiusRun(towerTree_t *tree, double centreX, double centreY, double radiusSquared, int start,
+                           int end, int *towersNum) {
+
+    int mid = start + (end - start) / 2;
+    bbox_t *runBox = &(tree->boxes[mid]);
+    long long population = 0;
+
+    if (nearestSquared(runBox, centreX, centreY) > radiusSquared) {
+        return 0;
+    }
+    if (farthestSquared(runBox, centreX, centreY) <= radiusSquared) {
+        *towersNum += end - start;
+        return tree->populations[mid];
+    }
+    if (end - start <= LEAF_TOWERS) {
+        for (int k = start; k < end; k++) {
+            if (isInCircle(centreX, centreY, radiusSquared, tree->x[k], tree->y[k])) {
+                (*towersNum)++;
+                population += tree->population[k];
+            }
+        }
+        return population;
+    }
+
+    if (isInCircle(centreX, centreY, radiusSquared, tree->x[mid], tree->y[mid])) {
+        (*towersNum)++;
+        population += tree->population[mid];
+    }
+    return population + radiusRun(tree, centreX, centreY, radiusSquared, start, mid, towersNum) +
+           radiusRun(tree, centreX, centreY, radiusSquared, mid + 1, end, towersNum);
+}
+
+/* Total population served by the towers within a radius of a centre, the circle included, and how many
+   there are */
+long long radiusSum(towerTree_t *tree, double centreX, double centreY, double radius, int *towersNum) {
+
+    *towersNum = 0;
+    return tree->towersNum > 0 ? radiusRun(tree, centreX, centreY, radius * radius, 0, tree->towersNum, towersNum) : 0;
+}
+
+/* Keep the tower at a position if it is nearer than the best so far, or as near with a lower index */
+static void tryTower(towerTree_t *tree, int k, double targetX, double targetY, int *best, double *bestSquared) {
+
+    double distance = (tree->x[k] - targetX) * (tree->x[k] - targetX) +
+                      (tree->y[k] - targetY) * (tree->y[k] - targetY);
+
+    if (distance < *bestSquared || (distance == *bestSquared && tree->towers[k] < *best)) {
+        *bestSquared = distance;
+        *best = tree->towers[k];
+    }
+}
+
+/* Search [start, end) for a nearer tower, the half nearer the point first so the other is often skipped.
+   Runs longer than a leaf have towers on both sides of their median */
+static void nearestRun(towerTree_t *tree, double targetX, double targetY, int start, int end, int *best,
+                       double *bestSquared) {
+
+    int mid = start + (end - start) / 2, lowMid, highMid;
+
+    if (nearestSquared(&(tree->boxes[mid]), targetX, targetY) > *bestSquared) {
+        return;
+    }
+    if (end - start <= LEAF_TOWERS) {
+        for (int k = start; k < end; k++) {
+            tryTower(tree, k, targetX, targetY, best, bestSquared);
+        }
+        return;
+    }
+
+    tryTower(tree, mid, targetX, targetY, best, bestSquared);
+    lowMid = start + (mid - start) / 2;
+    highMid = mid + 1 + (end - mid - 1) / 2;
+    if (nearestSquared(&(tree->boxes[lowMid]), targetX, targetY) <=
+        nearestSquared(&(tree->boxes[highMid]), targetX, targetY)) {
+        nearestRun(tree, targetX, targetY, start, mid, best, bestSquared);
+        nearestRun(tree, targetX, targetY, mid + 1, end, best, bestSquared);
+    } else {
+        nearestRun(tree, targetX, targetY, mid + 1, end, best, bestSquared);
+        nearestRun(tree, targetX, targetY, start, mid, best, bestSquared);
+    }
+}
+
+/* Index of the tower nearest a point, the lowest index of equally near ones, or -1 if there are none */
+int nearestTower(towerTree_t *tree, double targetX, double targetY) {
+
+    int best = -1;
+    double bestSquared = INFINITY;
+
+    if (tree->towersNum > 0) {
+        nearestRun(tree, targetX, targetY, 0, tree->towersNum, &best, &bestSquared);
+    }
+    return best;
+}
+
+/* Read queries one per line:
+     rectangle minX minY maxX maxY   population served by the towers in a box
+     radius x y r                    population served by the towers within r of (x, y)
+     nearest x y                     the tower nearest (x, y)
+   Bad queries are reported on stderr and skipped */
+towerQuery_t *readQueries(FILE *file, int *queriesNum) {
+
+    char line[LINE_SIZE], command[COMMAND_SIZE];
+    int maxQueries = QUERIES, fields;
+    towerQuery_t *queries = (towerQuery_t *) malloc(maxQueries * sizeof(towerQuery_t)), query;
+    assert(queries);
+
+    *queriesNum = 0;
+    while (fgets(line, LINE_SIZE, file) != NULL) {
+        fields = sscanf(line, "%15s %lf %lf %lf %lf", command, &query.a, &query.b, &query.c, &query.d);
+        if (fields < 1) {
+            continue;
+        }
+        if (strcmp(command, "rectangle") == 0 && fields == 5) {
+            query.kind = QUERY_RECTANGLE;
+        } else if (strcmp(command, "radius") == 0 && fields == 4 && query.c >= 0) {
+            query.kind = QUERY_RADIUS;
+        } else if (strcmp(command, "nearest") == 0 && fields == 3) {
+            query.kind = QUERY_NEAREST;
+        } else {
+            fprintf(stderr, "Unknown query: %s", line);
+            continue;
+        }
+        if (*queriesNum == maxQueries) {
+            maxQueries *= 2;
+            queries = realloc(queries, maxQueries * sizeof(towerQuery_t));
+            assert(queries);
+        }
+        queries[(*queriesNum)++] = query;
+    }
+
+    return queries;
+}
+
+/* Queries to answer, and one buffer for each task of the round being answered */
+typedef struct {
+    towerTree_t *tree;
+    towertable_t *towers;
+    towerQuery_t *queries;
+    int queriesNum;
+    int firstTask;
+    textBuffer_t *buffers;
+} queryJob_t;
+
+/* Answer the block of QUERIES_PER_TASK queries of one task */
+static void answerQueries(void *arg, int taskIdx, int threadIdx) {
+
+    queryJob_t *job = (queryJob_t *) arg;
+    textBuffer_t *buffer = &(job->buffers[taskIdx]);
+    int start = (job->firstTask + taskIdx) * QUERIES_PER_TASK, end = start + QUERIES_PER_TASK, towersNum;
+
+    if (end > job->queriesNum) {
+        end = job->queriesNum;
+    }
+    buffer->length = 0;
+    for (int q = start; q < end; q++) {
+        towerQuery_t *query = &(job->queries[q]);
+        if (query->kind == QUERY_NEAREST) {
+            int tower = nearestTower(job->tree, query->a, query->b);
+            if (tower < 0) {
+                APPEND_LITERAL(buffer, "No watchtowers\n");
+            } else {
+                appendTower(buffer, job->towers, tower);
+            }
+            continue;
+        }
+        if (query->kind == QUERY_RECTANGLE) {
+            bbox_t box = {query->a, query->b, query->c, query->d};
+            APPEND_LITERAL(buffer, "Rectangle population served: ");
+            appendInt(buffer, rectangleSum(job->tree, &box, &towersNum));
+        } else {
+            APPEND_LITERAL(buffer, "Radius population served: ");
+            appendInt(buffer, radiusSum(job->tree, query->a, query->b, query->c, &towersNum));
+        }
+        APPEND_LITERAL(buffer, ", Watchtowers: ");
+        appendInt(buffer, towersNum);
+        APPEND_LITERAL(buffer, "\n");
+    }
+}
+
+/* Answer queries in order, one line each. Blocks of queries are answered independently over threadsNum
+   threads, a round of a few blocks per thread at a time, and written out in order */
+void runQueries(towerTree_t *tree, towertable_t *towers, towerQuery_t *queries, int queriesNum, FILE *out,
+                int threadsNum) {
+
+    int tasksNum = (queriesNum + QUERIES_PER_TASK - 1) / QUERIES_PER_TASK, roundTasks = threadsNum * TASKS_PER_THREAD;
+    queryJob_t job = {tree, towers, queries, queriesNum, 0, NULL};
+
+    job.buffers = (textBuffer_t *) calloc(roundTasks, sizeof(textBuffer_t));
+    assert(job.buffers);
+
+    for (job.firstTask = 0; job.firstTask < tasksNum; job.firstTask += roundTasks) {
+        int roundNum = tasksNum - job.firstTask < roundTasks ? tasksNum - job.firstTask : roundTasks;
+        parallelFor(roundNum, threadsNum, answerQueries, &job);
+        for (int t = 0; t < roundNum; t++) {
+            flushText(&(job.buffers[t]), out);
+        }
+    }
+
+    for (int t = 0; t < roundTasks; t++) {
+        freeText(&(job.buffers[t]));
+    }
+    free(job.buffers);
+}
+
+void freeTowerTree(towerTree_t *tree) {
+
+    free(tree->towers);
+    free(tree->x);
+    free(tree->y);
+    free(tree->population);
+    free(tree->boxes);
+    free(tree->populations);
+    free(tree);
+}
@@ -0,0 +1,40 @@
+#ifndef TOWERTREE_H
+#define TOWERTREE_H
+
+    #include <stdio.h>
+    #include "watchtower.h"
+    #include "locate.h"
+
+    /* Bulk loaded k-d tree over the watchtowers. The towers are reordered so that every subtree is a run
+       [start, end) of positions, split at its median position mid = (start + end) / 2 across the wider
+       side of its box; runs of at most LEAF_TOWERS towers are scanned. Each run keeps its box and the
+       population it serves at its median position, so a query can take or skip a whole run at once */
+    typedef struct {
+        int towersNum;
+        int *towers;
+        double *x, *y;
+        int *population;
+        bbox_t *boxes;
+        long long *populations;
+    } towerTree_t;
+
+    /* Kinds of tower queries */
+    #define QUERY_RECTANGLE 0
+    #define QUERY_RADIUS 1
+    #define QUERY_NEAREST 2
+
+    typedef struct {
+        int kind;
+        double a, b, c, d;
+    } towerQuery_t;
+
+    towerTree_t *buildTowerTree(towertable_t *towers);
+    long long rectangleSum(towerTree_t *tree, bbox_t *box, int *towersNum);
+    long long radiusSum(towerTree_t *tree, double centreX, double centreY, double radius, int *towersNum);
+    int nearestTower(towerTree_t *tree, double targetX, double targetY);
+    towerQuery_t *readQueries(FILE *file, int *queriesNum);
+    void runQueries(towerTree_t *tree, towertable_t *towers, towerQuery_t *queries, int queriesNum, FILE *out,
+                    int threadsNum);
+    void freeTowerTree(towerTree_t *tree);
+
+#endif
@@ -1,53 +1,372 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "watchtower.h"
 #include "list.h"
+#include "parallel.h"
 
 #define BUFFERSIZE 513
-#define WATCHTOWER 1
+#define CHUNKS_PER_THREAD 4
+#define MIN_CHUNK_SIZE 65536
+#define MAX_DIGITS 19
+#define MAX_EXACT_MANTISSA (1ULL << 53)
+#define MAX_EXACT_POWER 22
+#define NUMBER_SIZE 64
 
-/* Read information of wacthtowers from input file */
-watchtower_t **readWatchtower(FILE *file, watchtower_t **watchTower, int *currentSize) {
+/* Powers of ten that are exact doubles */
+static const double powersOfTen[MAX_EXACT_POWER + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
 
-    char *line = NULL;
-    size_t lineBufferLength = BUFFERSIZE;
-    int maxSize = WATCHTOWER;
+/* Whole watchtower file split into chunks that start at line boundaries */
+typedef struct {
+    char *body;
+    char *end;
+    int chunksNum;
+    char **chunkStart;
+    int *chunkRows;
+    towertable_t *towers;
+} loadJob_t;
 
-    watchTower = (watchtower_t **) malloc(WATCHTOWER * sizeof(*watchTower));
-    assert(watchTower);
-    
-    /* Skip the header */
-    getline(&line, &lineBufferLength, file);
-    free(line);
-    line = NULL;
+/* Copy a field up to the next comma or the end of the line into the string arena, as %[^,] does.
+   Returns NULL if it is empty */
+static char *parseString(char *start, char *end, towertable_t *towers, stringref_t *field, size_t *cursor) {
+
+    char *comma = memchr(start, ',', end - start);
+    size_t length;
+
+    if (comma == NULL) {
+        comma = end;
+    }
+    length = comma - start;
+    if (length == 0) {
+        return NULL;
+    }
+    memcpy(towers->strings + *cursor, start, length);
+    towers->strings[*cursor + length] = '\0';
+    field->offset = *cursor;
+    field->length = (int) length;
+    *cursor += length + 1;
+
+    return comma;
+}
+
+/* Parse an integer as %d does, returns NULL if there are no digits or the number does not fit in an int */
+static char *parseInt(char *start, char *end, int *value) {
+
+    long long number = 0, limit;
+    int isNegative = 0, digit;
+    char *digits;
+
+    while (start < end && isspace((unsigned char) *start)) {
+        start++;
+    }
+    if (start < end && (*start == '-' || *start == '+')) {
+        isNegative = *start == '-';
+        start++;
+    }
+    limit = isNegative ? -(long long) INT_MIN : INT_MAX;
+    for (digits = start; start < end && isdigit((unsigned char) *start); start++) {
+        digit = *start - '0';
+        if (number > (limit - digit) / 10) {
+            return NULL;
+        }
+        number = number * 10 + digit;
+    }
+    if (start == digits) {
+        return NULL;
+    }
+    *value = (int) (isNegative ? -number : number);
+
+    return start;
+}
+
+/* Parse a double as %lf does. Plain decimals with at most 19 significant digits that fit in a double's
+   mantissa are scaled by an exact power of ten, which rounds once and so matches strtod. Anything else
+   goes to strtod. Returns NULL if there is no number */
+static char *parseDouble(char *start, char *end, double *value) {
+
+    unsigned long long mantissa = 0;
+    int digitsNum = 0, exponent = 0, isNegative = 0, isPlain = 1, hasDigits = 0;
+    char *number, buffer[NUMBER_SIZE], *copy, *copyEnd;
+    size_t length;
+
+    while (start < end && isspace((unsigned char) *start)) {
+        start++;
+    }
+    number = start;
+    if (start < end && (*start == '-' || *start == '+')) {
+        isNegative = *start == '-';
+        start++;
+    }
+    for (; start < end && isdigit((unsigned char) *start); start++) {
+        hasDigits = 1;
+        if (mantissa == 0 && *start == '0') {
+            continue;
+        }
+        if (digitsNum++ < MAX_DIGITS) {
+            mantissa = mantissa * 10 + (*start - '0');
+        } else {
+            isPlain = 0;
+        }
+    }
+    if (start < end && *start == '.') {
+        for (start++; start < end && isdigit((unsigned char) *start); start++) {
+            hasDigits = 1;
+            exponent--;
+            if (mantissa == 0 && *start == '0') {
+                continue;
+            }
+            if (digitsNum++ < MAX_DIGITS) {
+                mantissa = mantissa * 10 + (*start - '0');
+            } else {
+                isPlain = 0;
+            }
+        }
+    }
+    if (start < end && (*start == 'e' || *start == 'E' || *start == 'x' || *start == 'X' || isalpha((unsigned char) *start))) {
+        isPlain = 0;
+    }
+
+    if (isPlain && hasDigits && mantissa <= MAX_EXACT_MANTISSA && exponent >= -MAX_EXACT_POWER) {
+        *value = exponent < 0 ? (double) mantissa / powersOfTen[-exponent] : (double) mantissa;
+        if (isNegative) {
+            *value = -*value;
+        }
+        return start;
+    }
+
+    /* Let strtod deal with exponents, hex, inf/nan and long mantissas, on a terminated copy of the field up
+       to the next comma or space, neither of which a number holds. The copy goes on the heap in the rare
+       case that it is too long for the buffer, so a long number is never cut short */
+    start = number;
+    while (start < end && *start != ',' && !isspace((unsigned char) *start)) {
+        start++;
+    }
+    length = start - number;
+    copy = length < NUMBER_SIZE ? buffer : (char *) malloc(length + 1);
+    assert(copy);
+    memcpy(copy, number, length);
+    copy[length] = '\0';
+    *value = strtod(copy, &copyEnd);
+    start = copyEnd == copy ? NULL : number + (copyEnd - copy);
+    if (copy != buffer) {
+        free(copy);
+    }
+
+    return start;
+}
+
+/* Parse a line of "ID,postcode,population,contact,x,y" into a row of the table, its strings going to
+   the arena from cursor on. Like the sscanf it replaces, parsing stops at the first field that does not
+   match; fields after it are left empty */
+static void parseWatchtower(char *line, char *end, towertable_t *towers, int row, size_t cursor) {
+
+    stringref_t empty = {0, 0};
+
+    towers->ID[row] = towers->postcode[row] = towers->contact[row] = empty;
+    towers->populationServed[row] = 0;
+    towers->x[row] = towers->y[row] = 0;
+
+    if ((line = parseString(line, end, towers, &(towers->ID[row]), &cursor)) == NULL || line == end || *line++ != ',') {
+        return;
+    }
+    if ((line = parseString(line, end, towers, &(towers->postcode[row]), &cursor)) == NULL || line == end || *line++ != ',') {
+        return;
+    }
+    if ((line = parseInt(line, end, &(towers->populationServed[row]))) == NULL || line == end || *line++ != ',') {
+        return;
+    }
+    if ((line = parseString(line, end, towers, &(towers->contact[row]), &cursor)) == NULL || line == end || *line++ != ',') {
+        return;
+    }
+    if ((line = parseDouble(line, end, &(towers->x[row]))) == NULL || line == end || *line++ != ',') {
+        return;
+    }
+    parseDouble(line, end, &(towers->y[row]));
+}
+
+/* Find the end of the line starting at a given point, including its newline */
+static char *lineEnd(char *line, char *end) {
+
+    char *newline = memchr(line, '\n', end - line);
+
+    return newline ? newline + 1 : end;
+}
 
-    /* Read the rest */
-    while (getline(&line, &lineBufferLength, file) > 0) {
-        if (*currentSize == maxSize) {
+/* Count the rows of a chunk */
+static void countTask(void *arg, int chunk, int threadIdx) {
+
+    loadJob_t *job = (loadJob_t *) arg;
+    int rows = 0;
+
+    for (char *line = job->chunkStart[chunk]; line < job->chunkStart[chunk + 1]; line = lineEnd(line, job->end)) {
+        rows++;
+    }
+    job->chunkRows[chunk] = rows;
+}
+
+/* Parse the rows of a chunk into their slots, chunkRows holds the index of the chunk's first row.
+   A row's strings take at most one byte more than the row itself, so row r writes them to the arena
+   from 1 + (row offset in the body) + r on and chunks never overlap */
+static void parseTask(void *arg, int chunk, int threadIdx) {
+
+    loadJob_t *job = (loadJob_t *) arg;
+    int row = job->chunkRows[chunk];
+    char *next;
+
+    for (char *line = job->chunkStart[chunk]; line < job->chunkStart[chunk + 1]; line = next) {
+        next = lineEnd(line, job->end);
+        parseWatchtower(line, next, job->towers, row, 1 + (line - job->body) + row);
+        row++;
+    }
+}
+
+/* Read a whole stream that cannot be mapped into memory */
+static char *readAll(FILE *file, size_t *size) {
+
+    size_t maxSize = BUFFERSIZE, bytes;
+    char *data = (char *) malloc(maxSize);
+    assert(data);
+
+    *size = 0;
+    while ((bytes = fread(data + *size, 1, maxSize - *size, file)) > 0) {
+        *size += bytes;
+        if (*size == maxSize) {
             maxSize *= 2;
-            watchTower = realloc(watchTower, maxSize * sizeof(*watchTower));
-            assert(watchTower);
-        } 
-        watchTower[*currentSize] = (watchtower_t *) malloc(sizeof(watchtower_t));
-        assert(watchTower[*currentSize]);
-        sscanf(line, "%[^,],%[^,],%d,%[^,],%lf,%lf\n", 
-        watchTower[*currentSize]->ID, watchTower[*currentSize]->postcode, 
-        &(watchTower[*currentSize]->populationServed), watchTower[*currentSize]->contact, 
-        &(watchTower[*currentSize]->x), &(watchTower[*currentSize]->y));
-        (*currentSize)++;   
-    }
-
-    free(line);
-    
-    return watchTower;   
-}
-
-/* Free watchtower */
-void freeWatchTower(watchtower_t **watchTower, int watchTowerNum) {
-    
-    for (int i = 0; i < watchTowerNum; i++) {
-        free(watchTower[i]);
-    }
-    free(watchTower);
+            data = realloc(data, maxSize);
+            assert(data);
+        }
+    }
+
+    return data;
+}
+
+/* Size the arrays of a table for towersNum watchtowers with stringsSize bytes of strings, reallocating
+   only those too small for them. Byte 0 of the arena is the empty string every missing field points at */
+static void sizeTowerTable(towertable_t *towers, int towersNum, size_t stringsSize) {
+
+    towers->towersNum = towersNum;
+    if (towersNum + 1 > towers->maxTowers) {
+        towers->maxTowers = towersNum + 1;
+        towers->x = realloc(towers->x, towers->maxTowers * sizeof(double));
+        assert(towers->x);
+        towers->y = realloc(towers->y, towers->maxTowers * sizeof(double));
+        assert(towers->y);
+        towers->populationServed = realloc(towers->populationServed, towers->maxTowers * sizeof(int));
+        assert(towers->populationServed);
+        towers->ID = realloc(towers->ID, towers->maxTowers * sizeof(stringref_t));
+        assert(towers->ID);
+        towers->postcode = realloc(towers->postcode, towers->maxTowers * sizeof(stringref_t));
+        assert(towers->postcode);
+        towers->contact = realloc(towers->contact, towers->maxTowers * sizeof(stringref_t));
+        assert(towers->contact);
+    }
+    towers->stringsSize = stringsSize;
+    if (stringsSize > towers->maxStringsSize) {
+        towers->maxStringsSize = stringsSize;
+        towers->strings = realloc(towers->strings, stringsSize);
+        assert(towers->strings);
+    }
+    towers->strings[0] = '\0';
+}
+
+/* Read information of wacthtowers from input file into a new table */
+towertable_t *readWatchtower(FILE *file, int threadsNum) {
+
+    towertable_t *towers = (towertable_t *) calloc(1, sizeof(towertable_t));
+    assert(towers);
+
+    reloadWatchtower(towers, file, threadsNum);
+    return towers;
+}
+
+/* Read information of wacthtowers from input file into an existing table, in place of what it held. The
+   file is mapped into memory, cut into chunks at line boundaries and the chunks are parsed over threadsNum
+   threads straight into the table */
+void reloadWatchtower(towertable_t *towers, FILE *file, int threadsNum) {
+
+    struct stat status;
+    char *data = NULL;
+    size_t size = 0, bodySize, chunksNum;
+    int isMapped = 0, rows = 0;
+    loadJob_t job;
+
+    if (fstat(fileno(file), &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0) {
+        size = status.st_size;
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+        isMapped = data != MAP_FAILED;
+    }
+    if (!isMapped) {
+        data = readAll(file, &size);
+    }
+
+    /* Skip the header */
+    job.end = data + size;
+    job.body = size > 0 ? lineEnd(data, job.end) : data;
+
+    /* Cut the rest into chunks that end at a newline, sizes and counts are worked out in size_t */
+    if (threadsNum < 1) {
+        threadsNum = 1;
+    }
+    bodySize = (size_t) (job.end - job.body);
+    chunksNum = (size_t) threadsNum * CHUNKS_PER_THREAD;
+    if (chunksNum > bodySize / MIN_CHUNK_SIZE + 1) {
+        chunksNum = bodySize / MIN_CHUNK_SIZE + 1;
+    }
+    job.chunksNum = (int) chunksNum;
+    job.chunkStart = (char **) malloc((job.chunksNum + 1) * sizeof(char *));
+    assert(job.chunkStart);
+    job.chunkRows = (int *) malloc((job.chunksNum + 1) * sizeof(int));
+    assert(job.chunkRows);
+    job.chunkStart[0] = job.body;
+    for (int c = 1; c < job.chunksNum; c++) {
+        char *start = job.body + bodySize / chunksNum * c;
+        if (start < job.chunkStart[c - 1]) {
+            start = job.chunkStart[c - 1];
+        }
+        job.chunkStart[c] = start > job.body ? lineEnd(start - 1, job.end) : start;
+    }
+    job.chunkStart[job.chunksNum] = job.end;
+
+    /* Count rows, then turn the counts into the index of each chunk's first row */
+    parallelFor(job.chunksNum, threadsNum, countTask, &job);
+    for (int c = 0; c < job.chunksNum; c++) {
+        int chunkRows = job.chunkRows[c];
+        job.chunkRows[c] = rows;
+        rows += chunkRows;
+    }
+
+    job.towers = towers;
+    sizeTowerTable(towers, rows, 1 + (job.end - job.body) + rows);
+    if (rows > 0) {
+        parallelFor(job.chunksNum, threadsNum, parseTask, &job);
+    }
+
+    free(job.chunkRows);
+    free(job.chunkStart);
+    if (isMapped) {
+        munmap(data, size);
+    } else {
+        free(data);
+    }
+}
+
+/* Free a table of watchtowers */
+void freeWatchTower(towertable_t *towers) {
+
+    free(towers->strings);
+    free(towers->contact);
+    free(towers->postcode);
+    free(towers->ID);
+    free(towers->populationServed);
+    free(towers->y);
+    free(towers->x);
+    free(towers);
 }
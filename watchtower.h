@@ -1,17 +1,35 @@
 #ifndef WATCHTOWER_H
 #define WATCHTOWER_H
 
-    #define STRING_SIZE 129
+    #include <stddef.h>
 
+    /* A string in the string arena of a watchtower table */
     typedef struct {
-        char ID[STRING_SIZE];
-        char postcode[STRING_SIZE];
-        char contact[STRING_SIZE];
-        int populationServed;
-        double x, y;
-    } watchtower_t;
+        size_t offset;
+        int length;
+    } stringref_t;
 
-    watchtower_t **readWatchtower(FILE *file, watchtower_t **watchTower, int *currentSize);
-    void freeWatchTower(watchtower_t **watchTower, int watchTowerNum);
+    /* Watchtowers as parallel arrays. Coordinates and population served are dense, the rarely read
+       ID, postcode and contact are NUL-terminated strings in one arena. The arrays have room for maxTowers
+       watchtowers and the arena for maxStringsSize bytes, which a table read again reuses */
+    typedef struct {
+        int towersNum;
+        double *x;
+        double *y;
+        int *populationServed;
+        stringref_t *ID;
+        stringref_t *postcode;
+        stringref_t *contact;
+        char *strings;
+        size_t stringsSize;
+        int maxTowers;
+        size_t maxStringsSize;
+    } towertable_t;
+
+    #define TOWER_STRING(towers, field, tower) ((towers)->strings + (towers)->field[tower].offset)
+
+    towertable_t *readWatchtower(FILE *file, int threadsNum);
+    void reloadWatchtower(towertable_t *towers, FILE *file, int threadsNum);
+    void freeWatchTower(towertable_t *towers);
 
 #endif
@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+#include "list.h"
+#include "halfplane.h"
+#include "locate.h"
+#include "watchtower.h"
+#include "writer.h"
+#include "parallel.h"
+#include "stats.h"
+
+#define TEXT_SIZE 65536
+#define DIGITS_SIZE 24
+#define DOUBLE_SIZE 512
+#define DECIMALS 1000000
+#define MAX_FAST_DOUBLE 4000000000.0
+#define FACES_PER_TASK 4096
+#define TASKS_PER_THREAD 4
+
+/* Append text to a buffer, growing it geometrically */
+void appendText(textBuffer_t *buffer, const char *text, size_t length) {
+
+    if (buffer->length + length > buffer->maxLength) {
+        if (buffer->maxLength < TEXT_SIZE) {
+            buffer->maxLength = TEXT_SIZE;
+        }
+        while (buffer->length + length > buffer->maxLength) {
+            buffer->maxLength *= 2;
+        }
+        buffer->text = realloc(buffer->text, buffer->maxLength);
+        assert(buffer->text);
+    }
+    memcpy(buffer->text + buffer->length, text, length);
+    buffer->length += length;
+}
+
+/* Append the decimal digits of an unsigned number, at least width of them with leading zeros */
+static void appendDigits(textBuffer_t *buffer, unsigned long long value, int width) {
+
+    char digits[DIGITS_SIZE];
+    int start = DIGITS_SIZE;
+
+    do {
+        digits[--start] = '0' + value % 10;
+        value /= 10;
+        width--;
+    } while (value > 0 || width > 0);
+    appendText(buffer, digits + start, DIGITS_SIZE - start);
+}
+
+/* Append an integer as %d or %lld would write it */
+void appendInt(textBuffer_t *buffer, long long value) {
+
+    if (value < 0) {
+        APPEND_LITERAL(buffer, "-");
+        appendDigits(buffer, 0ull - (unsigned long long) value, 1);
+    } else {
+        appendDigits(buffer, value, 1);
+    }
+}
+
+/* Append a double as %lf would write it, rounded to six decimals with ties to even. The product with a
+   million is kept as its rounded value plus the exact error fma gives, so the rounding decision sees the
+   exact value. Values too large for that, or not finite, go through snprintf */
+void appendDouble(textBuffer_t *buffer, double value) {
+
+    char text[DOUBLE_SIZE];
+    double magnitude = fabs(value), scaled, error, whole, half;
+    unsigned long long units;
+
+    if (!(magnitude < MAX_FAST_DOUBLE)) {
+        appendText(buffer, text, snprintf(text, DOUBLE_SIZE, "%lf", value));
+        return;
+    }
+
+    scaled = magnitude * DECIMALS;
+    error = fma(magnitude, DECIMALS, -scaled);
+    whole = floor(scaled);
+    if (whole == scaled && error < 0) {
+        whole -= 1;
+    }
+    half = (scaled - whole - 0.5) + error;
+    units = (unsigned long long) whole;
+    if (half > 0 || (half == 0 && (units & 1))) {
+        units++;
+    }
+
+    if (signbit(value)) {
+        APPEND_LITERAL(buffer, "-");
+    }
+    appendDigits(buffer, units / DECIMALS, 1);
+    APPEND_LITERAL(buffer, ".");
+    appendDigits(buffer, units % DECIMALS, 6);
+}
+
+/* Append the line of a watchtower in the output format */
+void appendTower(textBuffer_t *buffer, towertable_t *towers, int tower) {
+
+    char *ID = TOWER_STRING(towers, ID, tower), *postcode = TOWER_STRING(towers, postcode, tower),
+         *contact = TOWER_STRING(towers, contact, tower);
+
+    APPEND_LITERAL(buffer, "Watchtower ID: ");
+    appendText(buffer, ID, strlen(ID));
+    APPEND_LITERAL(buffer, ", Postcode: ");
+    appendText(buffer, postcode, strlen(postcode));
+    APPEND_LITERAL(buffer, ", Population Served: ");
+    appendInt(buffer, towers->populationServed[tower]);
+    APPEND_LITERAL(buffer, ", Watchtower Point of Contact Name: ");
+    appendText(buffer, contact, strlen(contact));
+    APPEND_LITERAL(buffer, ", x: ");
+    appendDouble(buffer, towers->x[tower]);
+    APPEND_LITERAL(buffer, ", y: ");
+    appendDouble(buffer, towers->y[tower]);
+    APPEND_LITERAL(buffer, "\n");
+}
+
+/* Write out a buffer and empty it */
+void flushText(textBuffer_t *buffer, FILE *file) {
+
+    fwrite(buffer->text, 1, buffer->length, file);
+    buffer->length = 0;
+}
+
+/* Free the text of a buffer */
+void freeText(textBuffer_t *buffer) {
+
+    free(buffer->text);
+    buffer->text = NULL;
+    buffer->length = buffer->maxLength = 0;
+}
+
+/* Faces to write, and one buffer for each task of the round being formatted */
+typedef struct {
+    towertable_t *towers;
+    int facesNum;
+    int *faceStart;
+    int *faceTowers;
+    long long *facePopulation;
+    int isPopulation;
+    int firstTask;
+    textBuffer_t *buffers;
+} writeJob_t;
+
+/* Format the block of FACES_PER_TASK faces of one task, either their watchtowers or their population */
+static void formatFaces(void *arg, int taskIdx, int threadIdx) {
+
+    writeJob_t *job = (writeJob_t *) arg;
+    textBuffer_t *buffer = &(job->buffers[taskIdx]);
+    int start = (job->firstTask + taskIdx) * FACES_PER_TASK, end = start + FACES_PER_TASK;
+
+    if (end > job->facesNum) {
+        end = job->facesNum;
+    }
+    buffer->length = 0;
+    for (int i = start; i < end; i++) {
+        if (job->isPopulation) {
+            APPEND_LITERAL(buffer, "Face ");
+            appendInt(buffer, i);
+            APPEND_LITERAL(buffer, " population served: ");
+            appendInt(buffer, job->facePopulation[i]);
+            APPEND_LITERAL(buffer, "\n");
+            continue;
+        }
+        appendInt(buffer, i);
+        APPEND_LITERAL(buffer, "\n");
+        for (int k = job->faceStart[i]; k < job->faceStart[i + 1]; k++) {
+            appendTower(buffer, job->towers, job->faceTowers[k]);
+        }
+    }
+}
+
+/* Write the watchtowers of every face, then the population served in every face. Blocks of faces are
+   formatted independently over threadsNum threads, a round of a few blocks per thread at a time, and
+   written out in order */
+void writeFaces(FILE *file, towertable_t *towers, int facesNum, int *faceStart, int *faceTowers, 
+                long long *facePopulation, int threadsNum) {
+
+    int tasksNum = (facesNum + FACES_PER_TASK - 1) / FACES_PER_TASK, roundTasks = threadsNum * TASKS_PER_THREAD;
+    writeJob_t job = {towers, facesNum, faceStart, faceTowers, facePopulation, 0, 0, NULL};
+
+    job.buffers = (textBuffer_t *) calloc(roundTasks, sizeof(textBuffer_t));
+    assert(job.buffers);
+
+    for (job.isPopulation = 0; job.isPopulation <= 1; job.isPopulation++) {
+        for (job.firstTask = 0; job.firstTask < tasksNum; job.firstTask += roundTasks) {
+            int roundNum = tasksNum - job.firstTask < roundTasks ? tasksNum - job.firstTask : roundTasks;
+            parallelFor(roundNum, threadsNum, formatFaces, &job);
+            for (int t = 0; t < roundNum; t++) {
+                flushText(&(job.buffers[t]), file);
+            }
+        }
+    }
+
+    for (int t = 0; t < roundTasks; t++) {
+        freeText(&(job.buffers[t]));
+    }
+    free(job.buffers);
+}
+
+/* Locate the faces of each watchtower, over threadsNum threads, and write the output to output file.
+   Only the coordinates and population are touched while locating, the strings only when printing, which
+   is also spread over the threads. isWalk walks the dcel from face to face instead of scanning the grid
+   cells */
+void writeWatchTower(FILE *file, dcel_t *dcel, towertable_t *towers, int threadsNum, int isWalk) {
+
+    size_t faces = dcel->facesNum;
+    int *faceStart = NULL, *faceTowers = NULL;
+    long long *facePopulation = NULL;
+    matches_t matches = {0, 0, NULL, NULL};
+    faceGrid_t *grid = NULL;
+
+    STATS_START(PHASE_BUILD_GRID);
+    grid = buildFaceGrid(dcel);
+    STATS_STOP(PHASE_BUILD_GRID);
+
+    /* Find the faces of every watchtower through the face grid */
+    STATS_START(PHASE_LOCATE);
+    facePopulation = (long long *) calloc(faces, sizeof(long long));
+    assert(facePopulation);
+    if (isWalk) {
+        long long walkSteps = walkTowers(grid, towers->x, towers->y, towers->populationServed, towers->towersNum,
+                                         threadsNum, &matches, facePopulation);
+        STATS_COUNT(towerWalkSteps, walkSteps);
+    } else {
+        locateTowers(grid, towers->x, towers->y, towers->populationServed, towers->towersNum, threadsNum, 
+                     &matches, facePopulation);
+    }
+    STATS_STOP(PHASE_LOCATE);
+    STATS_START(PHASE_GROUP);
+    groupMatches(&matches, faces, towers->towersNum, &faceStart, &faceTowers);
+    STATS_STOP(PHASE_GROUP);
+
+    /* Write the watchtowers in each face, then the population served in each face */
+    STATS_START(PHASE_WRITE);
+    writeFaces(file, towers, faces, faceStart, faceTowers, facePopulation, threadsNum);
+    STATS_STOP(PHASE_WRITE);
+
+    free(facePopulation);
+    free(faceTowers);
+    free(faceStart);
+    freeMatches(&matches);
+    freeFaceGrid(grid);
+}
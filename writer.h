@@ -0,0 +1,28 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+    #include <stdio.h>
+    #include <stddef.h>
+    #include "list.h"
+    #include "watchtower.h"
+
+    /* Text formatted in memory, to be written out in one go */
+    typedef struct {
+        char *text;
+        size_t length;
+        size_t maxLength;
+    } textBuffer_t;
+
+    #define APPEND_LITERAL(buffer, literal) appendText((buffer), (literal), sizeof(literal) - 1)
+
+    void appendText(textBuffer_t *buffer, const char *text, size_t length);
+    void appendInt(textBuffer_t *buffer, long long value);
+    void appendDouble(textBuffer_t *buffer, double value);
+    void appendTower(textBuffer_t *buffer, towertable_t *towers, int tower);
+    void flushText(textBuffer_t *buffer, FILE *file);
+    void freeText(textBuffer_t *buffer);
+    void writeFaces(FILE *file, towertable_t *towers, int facesNum, int *faceStart, int *faceTowers, 
+                    long long *facePopulation, int threadsNum);
+    void writeWatchTower(FILE *file, dcel_t *dcel, towertable_t *towers, int threadsNum, int isWalk);
+
+#endif